@@ -3,16 +3,103 @@
 
 #include <Arduino.h>
 
+// Number of sequencer steps, 1 to 8
+// each step needs a relay pin in StepPinMap, HardwareConfig.h
+#define NSTEPS 4
+
+// Step times in 100 usec units, 0 to 6553.5 msec
+#define STEPUNITS_PER_MSEC 10
+#define STEPUNITS_MAX      0xFFFF
+
+// Step start, Start_100us
+// STEPSERIAL waits for the step before to finish, else the step starts this long
+// after the step before started, 0 with it, so independent relays move together
+// Step 0 starts on the key and the last step, the transmitter, is always serial,
+// it starts when every other relay is done and is released first, alone
+#define STEPSERIAL 0xFFFF
+
 // Configuration structure used for program and EEPROM
-struct sConfig_t {
-  struct sStep {            // Array of sequence step configs
+// packed with fixed size fields so the native build has the AVR layout
+// JOURNALVERSION 6, any layout change bumps it and adds a migration in GetConfig()
+struct __attribute__((packed)) sConfig_t {
+  struct __attribute__((packed)) sStep {  // Array of sequence step configs
     uint8_t    RxPolarity;  // Rx state, "normal" state Open or Closed
-    uint8_t    Tx_msec;     // msec
-    uint8_t    Rx_msec;     // msec
-  } Step[4];                // sequencer has 3 steps
+    uint16_t   Tx_100us;    // 100 usec units, relay assert time
+    uint16_t   Rx_100us;    // 100 usec units, relay release time
+    uint16_t   Start_100us; // 100 usec units after the step before starts, or STEPSERIAL
+  } Step[NSTEPS];           // sequencer has NSTEPS steps
   bool         RTSEnable;   // true enabled, false disabled
   bool         CTSEnable;   // true enabled, false disabled
-  unsigned int Timeout;     // sec, Tx timeout timer0 means disabled
+  uint16_t     Timeout;     // sec, Tx timeout timer0 means disabled
+  uint16_t     KeyAlive;    // msec, in-band serial key drops this long after the last key byte, 0 disables it
+  uint8_t      KeyAssert;   // msec, KEYPIN integrated this long before it keys, 0 keys at once
+  uint8_t      KeyRelease;  // msec, KEYPIN integrated this long before it unkeys, 0 unkeys at once
+  uint8_t      CTSLead;     // msec, CTS up this long after Tx is entered, with CTSEnable
+  uint8_t      CTSLag;      // msec, relays hold this long after CTS drops, then release
   uint16_t     CRC16;       // check for valid configuration table
 }; 
+
+// Older layouts, only read, GetConfig() migrates them to sConfig_t
+// V0.3 single copy at address 0 and JOURNALVERSION 1, step times in msec,
+// always 4 steps, from before NSTEPS
+#define V03STEPS 4
+struct __attribute__((packed)) sConfigV1_t {
+  struct __attribute__((packed)) sStep {
+    uint8_t    RxPolarity;
+    uint8_t    Tx_msec;
+    uint8_t    Rx_msec;
+  } Step[V03STEPS];
+  bool         RTSEnable;
+  bool         CTSEnable;
+  uint16_t     Timeout;
+  uint16_t     CRC16;
+};
+
+// JOURNALVERSION 2, added KeyAlive, NSTEPS steps from here on
+struct __attribute__((packed)) sConfigV2_t {
+  sConfigV1_t::sStep Step[NSTEPS];
+  bool         RTSEnable;
+  bool         CTSEnable;
+  uint16_t     Timeout;
+  uint16_t     KeyAlive;
+  uint16_t     CRC16;
+};
+
+// JOURNALVERSION 3, step times in 100 usec units
+struct __attribute__((packed)) sConfigV3_t {
+  struct __attribute__((packed)) sStep {
+    uint8_t    RxPolarity;
+    uint16_t   Tx_100us;
+    uint16_t   Rx_100us;
+  } Step[NSTEPS];
+  bool         RTSEnable;
+  bool         CTSEnable;
+  uint16_t     Timeout;
+  uint16_t     KeyAlive;
+  uint16_t     CRC16;
+};
+
+// JOURNALVERSION 4, added the key filter
+struct __attribute__((packed)) sConfigV4_t {
+  sConfigV3_t::sStep Step[NSTEPS];
+  bool         RTSEnable;
+  bool         CTSEnable;
+  uint16_t     Timeout;
+  uint16_t     KeyAlive;
+  uint8_t      KeyAssert;
+  uint8_t      KeyRelease;
+  uint16_t     CRC16;
+};
+
+// JOURNALVERSION 5, added the step start offsets
+struct __attribute__((packed)) sConfigV5_t {
+  sConfig_t::sStep Step[NSTEPS];
+  bool         RTSEnable;
+  bool         CTSEnable;
+  uint16_t     Timeout;
+  uint16_t     KeyAlive;
+  uint8_t      KeyAssert;
+  uint8_t      KeyRelease;
+  uint16_t     CRC16;
+};
 #endif
\ No newline at end of file
@@ -3,12 +3,7 @@
 
 // declare the global variables
 extern sConfig_t GlobalConf;
-extern char Msg[80];
-
-#ifdef DEBUG
-extern unsigned long ISR_Time;
-extern unsigned long Min_ISR_Time;
-extern unsigned long Max_ISR_Time;
-#endif
+// formatted output uses UiOut.PrintLine(), no shared message buffer
+// ISR and loop execution times are kept in Stats.cpp
 
 #endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include "HardwareConfig.h"
+
+// Hardware abstraction layer
+// Everything in src/ reaches registers through these functions
+// AVR build:    inline VPORT access here, the rest in HalAvr.cpp and StepTimer.cpp
+// NATIVE build: [env:native], Linux stand-ins in src/native for pins, timers,
+//               EEPROM and serial, so the sequencer and UI run on the host
+
+#ifdef NATIVE
+// simulated port registers, same fields as the AVR VPORT
+struct sHalPort_t {
+  uint8_t DIR;
+  uint8_t OUT;
+  uint8_t IN;
+  uint8_t INTFLAGS;
+};
+extern sHalPort_t HalPortA, HalPortB, HalPortC;
+#define HALPORTA HalPortA
+#define HALPORTB HalPortB
+#define HALPORTC HalPortC
+#else
+#define HALPORTA VPORTA
+#define HALPORTB VPORTB
+#define HALPORTC VPORTC
+#endif
+#define HALKEYPORT  HALPORTC  // port of KEYPIN
+#define HALRTSPORT  HALPORTA  // port of RTSPIN
+#define HALCTSPORT  HALPORTA  // port of CTSPIN
+#define HALXTRAPORT HALPORTB  // port of XTRA6PIN
+
+// Step outputs and XTRA mirrors, masked to the step bits of each port
+// Only called from interrupts, so the read-modify-write is not interrupted
+static inline void HalStepOutputs(uint8_t A, uint8_t B, uint8_t C) {
+  HALPORTA.OUT = (HALPORTA.OUT & ~STEP_PORTA_MASK) | A;
+  HALPORTB.OUT = (HALPORTB.OUT & ~STEP_PORTB_MASK) | B;
+  HALPORTC.OUT = (HALPORTC.OUT & ~STEP_PORTC_MASK) | C;
+}
+
+// Raw pin levels, Key and RTS are low true
+static inline bool HalKeyPin() {
+  return HALKEYPORT.IN & KEYPIN_bm;
+}
+
+static inline bool HalRTSPin() {
+  return HALRTSPORT.IN & RTSPIN_bm;
+}
+
+// CTS output, CTS_UP or CTS_DOWN
+static inline void HalCTS(uint8_t Level) {
+  if (Level) {
+    HALCTSPORT.OUT |= CTSPIN_bm;
+  } else {
+    HALCTSPORT.OUT &= ~CTSPIN_bm;
+  }
+}
+
+// Key indicator on XTRA6PIN for the scope
+static inline void HalKeyIndicator(bool Key) {
+  if (Key) {
+    HALXTRAPORT.OUT |= XTRA6_bm;
+  } else {
+    HALXTRAPORT.OUT &= ~XTRA6_bm;
+  }
+}
+
+// Free running cycle counter for execution time stats, TCA0 at F_CPU/8
+// 16 bits, HALCYCLE_NSEC per count, wraps every 26 msec
+#define HALCYCLE_NSEC     (8000000000UL / F_CPU)  // 400 nsec at 20 MHz
+#define HALCYCLE_WRAPMSEC (65536UL * HALCYCLE_NSEC / 1000000)
+#ifdef NATIVE
+uint16_t HalCycles();
+#else
+// 16 bit read through the shared TEMP register, an interrupt reading TCA0 between
+// the two bytes would corrupt it, so the bytes are read with interrupts off
+static inline uint16_t HalCycles() {
+  uint8_t Sreg = SREG;
+  cli();
+  uint16_t Count = TCA0.SINGLE.CNT;
+  SREG = Sreg;
+  return Count;
+}
+#endif
+
+// Timebase, HalCycles() extended by a count of counter overflows
+// The one clock for step moves, the key filter, Tx timeout, serial key dead-man,
+// key latency, trace and sleep accounting, a few cycles more than HalCycles()
+// It counts the TCA0 clock in hardware, with no correction factor and no millis()
+// rounding, spans added up tick by tick do not drift from the oscillator
+// Overflow: unsigned 32 bits, wraps every HALTIME_WRAPSEC, 28.6 minutes at 20 MHz
+// A span, Later - Earlier as HalTime_t, is exact across the wrap while shorter than that
+typedef uint32_t HalTime_t;
+#define HALTIME_PER_MSEC (1000000UL / HALCYCLE_NSEC)  // 2500 at 20 MHz
+#define HALTIME_WRAPSEC  ((uint32_t) (4294967296ULL * HALCYCLE_NSEC / 1000000000UL))
+static_assert(1000000UL % HALCYCLE_NSEC == 0, "HALCYCLE_NSEC must divide a msec");
+HalTime_t HalTime();
+
+// span in usec, 32 bit math, good for any span up to the wrap
+static inline uint32_t HalTimeToUsec(HalTime_t Span) {
+  return Span / HALTIME_PER_MSEC * 1000 + Span % HALTIME_PER_MSEC * 1000 / HALTIME_PER_MSEC;
+}
+
+// Public functions, HalAvr.cpp or native/HalNative.cpp
+void HalTickInit(void (*Callback)()); // periodic sequencer tick, TIMER1_INTERVAL_MS to start
+void HalTickSet(uint8_t Interval_ms); // tick period, 0 stops it, any context
+void HalKeyEdgesInit();               // KEYPIN and RTSPIN pin change interrupts to KeyEdgeISR()
+void HalCycleInit();                  // start the HalCycles() and HalTime() counter, stops millis()
+void HalReset();                      // software reset, as if from power up
+void HalTimeoutInit();                // start the RTC, before HalTickInit() and HalKeyEdgesInit(), both arm it
+void HalTimeoutArm(uint8_t Seconds);  // TxTimeoutISR() once, Seconds from now, replaces any armed
+void HalTimeoutStop();                // disarm, any context
+uint16_t HalTimeoutLeft();            // HALTIMEOUT_PER_SEC counts to expiry, 0 when not armed
+void HalIdle();                       // between loop() passes, sleep until the next interrupt
+void StackPaint();                    // fill free RAM with a pattern, first thing in setup()
+uint16_t StackUnused();               // bytes of painted RAM never used by the stack
+
+#define TIMER1_INTERVAL_MS 10         // sequencer tick at power up, msec
+#define HALTICKS_PER_MSEC HALTIME_PER_MSEC            // tick timer counts, TCA0 clock
+#define HALTICK_MAXMSEC   (65536UL / HALTICKS_PER_MSEC) // longest tick, 26 msec at 20 MHz
+
+// Tx timeout watchdog on the RTC, 32.768 kHz internal oscillator / 256
+// Armed on the first key input and stopped when all are released, no tick needed
+// Expires one count late at most, never early, 7.8 msec
+#define HALTIMEOUT_PER_SEC 128
+static_assert(255 * HALTIMEOUT_PER_SEC < 0x8000, "Tx timeout past half the RTC count");
+
+#endif
@@ -47,6 +47,41 @@
 #define XTRA5PIN  PIN_PB5   // MCU  6,    JP2 5
 #define XTRA6PIN  PIN_PB4   // MCU  7,    JP2 6
 
+// Port registers for the key pin change interrupts, must match KEYPIN and RTSPIN
+#define KEYPORT     PORTC
+#define KEYPINCTRL  PIN3CTRL
+#define KEYPIN_bm   PIN3_bm
+#define RTSPORT     PORTA
+#define RTSPINCTRL  PIN1CTRL
+#define RTSPIN_bm   PIN1_bm
+#define CTSPIN_bm   PIN2_bm
+
+// Port bits for the step outputs written by the sequencer ISR
+// must match S1T_PIN to S4T_PIN and XTRA1PIN to XTRA4PIN
+#define S1_bm       PIN2_bm   // PC2
+#define S2_bm       PIN1_bm   // PC1
+#define S3_bm       PIN0_bm   // PC0
+#define S4_bm       PIN0_bm   // PB0
+#define XTRA1_bm    PIN4_bm   // PA4
+#define XTRA2_bm    PIN5_bm   // PA5
+#define XTRA3_bm    PIN6_bm   // PA6
+#define XTRA4_bm    PIN7_bm   // PA7
+#define XTRA6_bm    PIN4_bm   // PB4
+#define STEP_PORTA_MASK (XTRA1_bm | XTRA2_bm | XTRA3_bm | XTRA4_bm)
+#define STEP_PORTB_MASK (S4_bm)
+#define STEP_PORTC_MASK (S1_bm | S2_bm | S3_bm)
+
+// Port bits of each step, relay output and its XTRA mirror, step 1 first
+// One entry per step, NSTEPS in Config.h, a change there needs pins here
+struct StepPinMap {
+  static constexpr uint8_t A[] = {XTRA1_bm, XTRA2_bm, XTRA3_bm, XTRA4_bm};
+  static constexpr uint8_t B[] = {0,        0,        0,        S4_bm   };
+  static constexpr uint8_t C[] = {S1_bm,    S2_bm,    S3_bm,    0       };
+};
+static_assert(sizeof(StepPinMap::A) == NSTEPS, "NSTEPS changed, give each step its pins in StepPinMap::A, include/HardwareConfig.h");
+static_assert(sizeof(StepPinMap::B) == NSTEPS, "NSTEPS changed, give each step its pins in StepPinMap::B, include/HardwareConfig.h");
+static_assert(sizeof(StepPinMap::C) == NSTEPS, "NSTEPS changed, give each step its pins in StepPinMap::C, include/HardwareConfig.h");
+
 // Key input hardware connection
 // Optoisolator has LED that drives NPN transistor 
 // Key input MCU pin is pulled up internally, NPN pulls it down
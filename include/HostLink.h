@@ -0,0 +1,65 @@
+#ifndef HOSTLINK_H
+#define HOSTLINK_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// Serial input, text lines for the user interface and binary frames for host tools
+// Every received byte passes through HostLinkPoll(), called each loop() pass
+// A byte equal to LINK_SYNC starts a frame, LINK_KEYDOWN and LINK_KEYUP outside
+// a frame key the sequencer, anything else is text
+// Terminals send 7 bit text, so these bytes never appear in a typed line
+//
+// Frame, both directions
+//   LINK_SYNC, Len, Cmd, Payload[Len], CRC16 low, CRC16 high
+//   CRC16 is calcCRC16() from the CRC library over Len, Cmd and Payload, as CalcCRC()
+// The reply to Cmd is Cmd | LINK_REPLY, or LINK_NAK with one LINK_ERR_ byte
+// A frame not complete within LINK_TIMEOUTMS is dropped, the next byte is text again
+// A reply goes out through UiOut in one write, whole or not at all, the host retries
+//
+// Round trip in bytes on the wire, LINK_OVERHEAD per frame plus payload
+//   get-config  5 + (5 + sizeof(sConfig_t)), 50 with NSTEPS 4, about 9 msec at 57600
+//   set-config  (5 + sizeof(sConfig_t)) + 5
+//   get-status  5 + (5 + sizeof(sLinkStatus_t))
+//   get-stats   5 + (5 + STAT_COUNT * sizeof(sStats_t))
+// The text 'display' for the same config is over 300 bytes
+#define LINK_SYNC      0xA5
+#define LINK_KEYDOWN   0xA6  // in-band key, ORed with KEYPIN and RTSPIN, repeat within Config.KeyAlive
+#define LINK_KEYUP     0xA7  // in-band unkey
+#define LINK_OVERHEAD  5     // sync, length, command, CRC16
+#define LINK_MAXLEN    96    // largest payload, either direction
+#define LINK_TIMEOUTMS 100   // msec, sync to last byte
+
+#define LINK_GETCONFIG 0x01  // reply payload sConfig_t, as published, CRC16 always current
+#define LINK_SETCONFIG 0x02  // payload sConfig_t with a valid CRC16, reply empty, an older layout fails on length
+#define LINK_GETSTATUS 0x03  // reply payload sLinkStatus_t
+#define LINK_GETSTATS  0x04  // reply payload sStats_t for each StatId
+#define LINK_REPLY     0x80  // or'd into the command of a reply
+#define LINK_NAK       0x7F  // reply payload one LINK_ERR_ byte
+
+#define LINK_ERR_CRC     1   // frame CRC16 wrong
+#define LINK_ERR_LENGTH  2   // Len too big, or wrong for the command
+#define LINK_ERR_COMMAND 3   // unknown command
+#define LINK_ERR_CONFIG  4   // set-config payload failed isConfigValid()
+
+// get-status reply, fixed layout for the host
+struct __attribute__((packed)) sLinkStatus_t {
+  uint8_t  State;          // State_t, SequencerStateMachine.h
+  uint16_t Dirty;          // ConfigDirtyFields(), CONF_ bits not yet in EEPROM
+  uint16_t KeyLatency;     // usec
+  uint16_t MaxKeyLatency;  // usec
+  uint16_t StackUnused;    // bytes
+  uint16_t Dropped;        // UiOut bytes dropped
+  uint16_t LinkErrors;     // frames dropped, CRC, length, command or timeout
+  uint16_t KeyExpiries;    // in-band key dropped by the KeyAlive dead-man
+  uint16_t KeyGlitches;    // KEYPIN pulses rejected by the key filter
+  uint16_t TxTimeouts;     // Tx timeouts since boot
+  uint16_t TxTimeoutLeft;  // 0.1 sec to the Tx timeout, 0 when not running
+  uint16_t MaxCTSLatency;  // usec, key drop to CTS down
+};
+
+// Public functions
+void    HostLinkPoll(sConfig_t *pConfig);            // every loop() pass and while loop() waits
+uint8_t HostLinkReadLine(char *Line, uint8_t Size); // text line length, 0 none yet, Size when it was too long
+
+#endif
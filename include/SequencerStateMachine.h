@@ -5,9 +5,62 @@
 
 #include "Config.h"
 
+// Key edge interrupt
+// 1: KEYPIN and RTSPIN pin change interrupts run the key transition immediately
+// 0: key sampled on the timer tick only, edges just timestamp for the latency measurement
+#define KEYEDGEISR 1
+
+// Key change part way through a step
+// 1: each relay's progress toward Tx is kept, a release waits only for the part of
+//    Rx_100us it needs to undo, a re-assert during release only for the rest of Tx_100us
+// 0: every step entered waits its full configured time
+#ifndef FASTABORT
+#define FASTABORT 1
+#endif
+
+// Sequencer tick by state, msec, 0 for no tick, HALTICK_MAXMSEC at most
+// Steps end on the StepTimer deadline and the Tx timeout on the RTC, not on the tick,
+// the tick runs the serial key dead-man and a backstop key sample
+// Steady Rx and Tx have nothing to time, key edges interrupt,
+// but without KEYEDGEISR the tick is the only key sample
+// Override per build with -D, the native build prints the timing error of each setting
+#ifndef TICK_RX_MS
+#if KEYEDGEISR
+#define TICK_RX_MS   0   // steady Rx, unkeyed
+#else
+#define TICK_RX_MS   10
+#endif
+#endif
+#ifndef TICK_STEP_MS
+#define TICK_STEP_MS 1   // S1T to SnT and SnR to S1R
+#endif
+#ifndef TICK_TX_MS
+#define TICK_TX_MS   20  // steady Tx or timed out Rx, serial key down or no KEYEDGEISR
+#endif
+
+// State Machine state number, Rx, S1T to SnT, Tx, SnR to S1R, see SequencerTable.h
+typedef uint8_t State_t;
+#define STATE_RX 0             // SeqTable_t::Rx
+#define STATE_TX (NSTEPS + 1)  // SeqTable_t::Tx
+
 // Public funtion
-void StateMachine(sConfig_t Config, bool Key, int TimeLoop);
+State_t StateMachine(const sConfig_t &Config, bool Key);
+State_t StateMachineState();
+void StateName(State_t State, char *Name);  // Rx, Tx, SnT or SnR, Name holds 6
 void SequencerISR();
+void PublishConfig(const sConfig_t &Config);  // after any config change, taken now in Rx, else at next Rx
+void KeyEdgeISR();
+void SerialKey(bool Keyed);    // in-band key byte, loop() context
+uint16_t SerialKeyExpiries();  // in-band key dropped by the KeyAlive dead-man
+uint16_t KeyGlitches();        // KEYPIN pulses the key filter rejected
+void StepDeadlineISR();
+void TxTimeoutISR();           // RTC watchdog expiry, HalTimeoutArm()
+uint16_t TxTimeouts();         // Tx timeouts since boot
+uint16_t TxTimeoutLeft();      // 0.1 sec to the Tx timeout, 0 when not running
+unsigned int KeyLatency();     // usec, last key edge to state change
+unsigned int MaxKeyLatency();  // usec, worst case since boot
+unsigned int CTSLatency();     // usec, interrupt that dropped the key to CTS down
+unsigned int MaxCTSLatency();  // usec, worst case since boot
 
 #endif
 
@@ -0,0 +1,81 @@
+#ifndef SEQUENCERTABLE_H
+#define SEQUENCERTABLE_H
+
+#include <Arduino.h>
+
+// Compile time transition table for an N step sequencer
+//
+// States numbered
+//   0            Rx
+//   1 to N       S1T to SnT, assert step 1 to n, forward chain
+//   N+1          Tx
+//   N+2 to 2N+1  SnR to S1R, release step n to 1, reverse chain
+//
+// Every state has a KeyHold level
+//   Key == KeyHold, timed states wait for the step deadline then go to OnTimer,
+//                   Rx and Tx hold
+//   Key != KeyHold, go to OnChange at once, the matching state in the other chain
+//
+// Output image of a state is the Rx image of the config XOR the Assert bits,
+// the port bits of every step that is in Tx polarity in that state
+//
+// PinMap supplies A[], B[] and C[], the port bits of each step, step 1 first
+
+#define NOSTEP 0xFF  // Step of Rx and Tx, untimed
+
+struct sSeqRow_t {
+  uint8_t KeyHold;   // Key level that continues this state
+  uint8_t OnChange;  // next state when Key != KeyHold
+  uint8_t OnTimer;   // next state when the step deadline is reached
+  uint8_t Step;      // index into Config.Step[], NOSTEP for Rx and Tx
+  uint8_t AssertA;   // port bits of asserted steps, XOR with Rx image
+  uint8_t AssertB;
+  uint8_t AssertC;
+};
+
+template <uint8_t N, class PinMap>
+struct sSeqTable {
+  static constexpr uint8_t States = 2 * N + 2;
+  static constexpr uint8_t Rx     = 0;
+  static constexpr uint8_t Tx     = N + 1;
+
+  static_assert((N >= 1) && (N <= 8), "sequencer supports 1 to 8 steps");
+  static_assert(sizeof(PinMap::A) == N, "PinMap::A needs one entry per step, StepPinMap in include/HardwareConfig.h");
+  static_assert(sizeof(PinMap::B) == N, "PinMap::B needs one entry per step, StepPinMap in include/HardwareConfig.h");
+  static_assert(sizeof(PinMap::C) == N, "PinMap::C needs one entry per step, StepPinMap in include/HardwareConfig.h");
+
+  sSeqRow_t Row[States];
+
+  // state that asserts step k, 0 based
+  static constexpr uint8_t AssertState(uint8_t k)  { return k + 1; }
+  // state that releases step k, 0 based
+  static constexpr uint8_t ReleaseState(uint8_t k) { return 2 * N + 1 - k; }
+
+  constexpr sSeqTable() : Row{} {
+    Row[Rx] = Row_(0, AssertState(0), Rx, NOSTEP, 0);
+    Row[Tx] = Row_(1, ReleaseState(N - 1), Tx, NOSTEP, N);
+    for (uint8_t k = 0; k < N; k++) {
+      // SkT, step k and all below it asserted
+      Row[AssertState(k)] = Row_(1, ReleaseState(k),
+                                 (k == N - 1) ? Tx : AssertState(k + 1), k, k + 1);
+      // SkR, step k released, steps below it still asserted
+      Row[ReleaseState(k)] = Row_(0, AssertState(k),
+                                  (k == 0) ? Rx : ReleaseState(k - 1), k, k);
+    }
+  }
+
+ private:
+  // Asserted is the number of steps in Tx polarity, always the lowest ones
+  static constexpr sSeqRow_t Row_(uint8_t KeyHold, uint8_t OnChange, uint8_t OnTimer,
+                                  uint8_t Step, uint8_t Asserted) {
+    sSeqRow_t R{KeyHold, OnChange, OnTimer, Step, 0, 0, 0};
+    for (uint8_t k = 0; k < Asserted; k++) {
+      R.AssertA |= PinMap::A[k];
+      R.AssertB |= PinMap::B[k];
+      R.AssertC |= PinMap::C[k];
+    }
+    return R;
+  }
+};
+
+#endif
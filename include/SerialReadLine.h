@@ -1,9 +0,0 @@
-#ifndef SERIALREADLINE_H
-#define SERIALREADLINE_H
-
-#include <serial-readline.h>
-
-// serial-readline library setup
-SerialLineReader reader(Serial);
-
-#endif
\ No newline at end of file
@@ -7,10 +7,45 @@
 
 // Public functions
 sConfig_t InitDefaultConfig();             // initialze config structure in memory
-sConfig_t GetConfig(uint8_t address); // read config from EEPROM
-void PutConfig(uint8_t address, sConfig_t Config); // write config if needed, update CRC16
-uint16_t CalcCRC(sConfig_t Config);
-bool isConfigValid(sConfig_t Config); // check config.CRC16
-void PrintConfig(sConfig_t Config); // pretty print config on serial port
+sConfig_t GetConfig();                     // read newest config from EEPROM journal, migrating older layouts
+void PutConfig(const sConfig_t &Config);   // write config to next journal slot, CRC16 already set
+uint16_t CalcCRC(const sConfig_t &Config);
+bool isConfigValid(const sConfig_t &Config); // check config.CRC16
+void PrintConfig(const sConfig_t &Config); // pretty print config on serial port, blocking
+#define KEYALIVEMAX 10000  // msec, longest Config.KeyAlive
+#define KEYFILTERMAX 50    // msec, longest Config.KeyAssert and KeyRelease
+#define CTSGUARDMAX 255    // msec, longest Config.CTSLead and CTSLag
+#define TIMEOUTMAX 255     // sec, longest Config.Timeout, HalTimeoutArm() takes 8 bits
+#define CONFIGLINES (NSTEPS + 7)  // lines from ConfigLine()
+bool ConfigLine(const sConfig_t &Config, uint8_t Index, char *Line); // line Index of PrintConfig(), false past the end
+
+// EEPROM config journal
+// EEPROM is a ring of fixed size slots, each holding one versioned config record
+// Each write goes to the slot after the newest, with the sequence number one higher
+// Boot scans every slot once, the valid record with the highest sequence number wins
+// A torn write fails its record CRC, leaving the previous record as the newest
+// Each cell is written once per JOURNALSLOTS commits
+// Slot size follows the record size, so each version has its own slot ring
+// With no current record, GetConfig() takes the newest version 5 to 1 record,
+// else the V0.3 image at address 0, converts it and writes it as a current record
+// in a slot clear of the old one, a torn upgrade leaves the old record readable
+#define JOURNALVERSION 6  // bump when sConfig_t layout changes, 1 to 5 are sConfigV1_t to sConfigV5_t
+
+// Deferred config commit
+// UserConfig() marks the fields it edits, loop() calls CommitConfig() every pass
+// Edits are coalesced and written once after COMMITQUIETMS without edits, or on 'Save'
+// When nothing is dirty CommitConfig() returns without any CRC or EEPROM work
+#define CONF_STEP0   0x0001  // Step[0] polarity or timing, Step[n] is CONF_STEP0 << n
+#define CONF_RTS     0x0100
+#define CONF_CTS     0x0200
+#define CONF_TIMEOUT 0x0400
+#define CONF_KEYALIVE 0x0800
+#define CONF_KEYFILTER 0x1000
+#define CONF_ALL     0x1FFF
+#define COMMITQUIETMS 2000 // msec, no edits for this long before EEPROM write
+
+void MarkConfigDirty(uint16_t Fields);            // note edited fields, restart quiet period
+uint16_t ConfigDirtyFields();                     // fields edited but not yet in EEPROM
+bool CommitConfig(sConfig_t *pConfig, bool Force); // CRC and write if dirty and quiet, or forced
 
 #endif
@@ -0,0 +1,51 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+// Execution time stats, always on
+// Each record keeps count, min, mean, max and a log2 histogram in usec
+// bin 0 is under 2 usec, bin k is 2^k to 2^(k+1) - 1 usec, the last bin is open ended
+// Times come from HalCycles(), a few instructions per measurement
+#define STATBINS 16
+
+enum StatId {
+  STAT_ISR,   // sequencer interrupts, tick, key edge, step deadline and Tx timeout
+  STAT_LOOP,  // loop() pass, UserConfig() and CommitConfig()
+  STAT_COUNT
+};
+
+// one record, also the get-stats payload in HostLink.h, packed for the host
+struct __attribute__((packed)) sStats_t {
+  uint32_t Count;
+  uint32_t Sum;             // usec, for the mean
+  uint16_t Min;             // usec
+  uint16_t Max;             // usec, saturates at 65535
+  uint16_t Bin[STATBINS];   // counts, saturate at 65535
+};
+
+// Sleep accounting, loop() sleeps in HalIdle() between passes
+// Per sequencer state class, wakes, time asleep and time spent in the class,
+// in HalTime() counts
+// Current is an estimate, awake and asleep time weighted by the datasheet
+// typical supply current, ATtiny1616 at 20 MHz and 5 V, change for other boards
+#define STATS_ACTIVE_UA 9000  // uA, active
+#define STATS_IDLE_UA   2800  // uA, IDLE sleep, peripherals running
+
+enum WakeClass {
+  WAKE_RX,    // steady receive
+  WAKE_SEQ,   // stepping, S1T to SnT or SnR to S1R
+  WAKE_TX,    // steady transmit
+  WAKE_COUNT
+};
+
+// Public functions
+void StatsAdd(uint8_t Id, uint16_t Start);                          // cycles since Start, spans under HALCYCLE_WRAPMSEC
+void StatsAddLong(uint8_t Id, HalTime_t Start);                     // any span, HalTime() past the HalCycles() wrap
+void StatsReset();
+void StatsIdle(HalTime_t SleepStart);                               // after HalIdle(), SleepStart is HalTime() before it
+void StatsGet(uint8_t Id, sStats_t &S);                             // snapshot of record Id
+bool StatsLine(uint8_t Index, char *Line);                          // 'stats' printout for UiOutLines()
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef STEPTIMER_H
+#define STEPTIMER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// One shot step deadline on TCB0
+// Clocked at F_CPU/2, 0.1 usec per tick at 20 MHz
+// Deadlines longer than one 16 bit period run as several compare periods
+#define STEPTICKS_PER_MSEC    (F_CPU / 2 / 1000)
+#define MSEC_TO_STEPTICKS(ms) ((uint32_t) (ms) * STEPTICKS_PER_MSEC)
+#define UNITS_TO_STEPTICKS(u) ((uint32_t) (u) * (STEPTICKS_PER_MSEC / STEPUNITS_PER_MSEC)) // Config step times
+#define STEPCHUNK             50000  // ticks, 5 msec compare period for long deadlines
+
+// Public functions
+void StepTimerInit();               // configure TCB0, timer stopped
+void StepTimerArm(uint32_t Ticks);  // start deadline, cancels any pending, 0 means done now
+bool StepTimerDone();               // true once the armed deadline is reached
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Sequencer timeline, a RAM ring of the last TRACELEN events
+// Each record is an event code, one argument byte and a HalTime() timestamp,
+// added from the interrupts with no formatting or serial output
+// The 'trace' command prints it, oldest first, with the time since the previous event
+// Timestamps wrap every HALTIME_WRAPSEC, 28 minutes at 20 MHz
+#define TRACELEN 32   // records, 6 bytes each
+
+enum TraceEvent {
+  TRACE_STATE,    // state entry, Arg is the State_t
+  TRACE_KEY,      // key edge, Arg is TRACEKEY_ bits after the edge
+  TRACE_TIMEOUT,  // Arg TRACETO_TX Tx timeout, TRACETO_KEYALIVE serial key dead-man
+  TRACE_GLITCH,   // KEYPIN pulse rejected by the key filter, Arg is the filtered key
+  TRACE_CTS,      // CTS output, Arg 1 up, 0 down
+  TRACE_COUNT
+};
+
+#define TRACEKEY_PIN    0x01  // KEYPIN asserted
+#define TRACEKEY_RTS    0x02  // RTSPIN asserted
+#define TRACEKEY_SERIAL 0x04  // in-band serial key down
+#define TRACETO_TX       0
+#define TRACETO_KEYALIVE 1
+
+// Public functions
+void TraceAdd(uint8_t Event, uint8_t Arg);   // interrupt context, or loop() with interrupts off
+void TraceHold(bool Hold);                   // stop recording while the ring is printed
+void TraceReset();
+bool TraceLine(uint8_t Index, char *Line);   // 'trace' printout for UiOutLines()
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef UIOUT_H
+#define UIOUT_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// User interface output that never blocks loop()
+// Writes go into the core's Serial TX ring, SERIAL_TX_BUFFER_SIZE in platformio.ini,
+// drained by the USART data register empty interrupt
+// A write that does not fit in the ring is dropped whole and counted, never split
+// PrintLine() and println() of a string put out the text and its \r\n whole or
+// not at all, the other Print calls are one write per piece
+// Bulk text, help, display and stats, goes out a line at a time through UiOutLines(),
+// which only writes lines that fit and resumes on the next loop() pass
+// UserConfig() skips a pass until UIOUT_PASSROOM is free, so prompts and
+// messages, at most two lines per pass, are not dropped in normal use
+#define UIOUT_NONBLOCKING 1  // 0: wait for room like Serial, to compare loop pass times
+#define UIOUT_LINELEN     80 // longest line from a UiLine_t source, with the terminator
+#define UIOUT_PASSROOM    (2 * (UIOUT_LINELEN + 2)) // free TX ring before a UserConfig() pass
+
+class UiOutClass : public Print {
+ public:
+  size_t   write(uint8_t c);
+  size_t   write(const uint8_t *Buf, size_t Len);
+  using    Print::write;
+  size_t   println(const char *s);  // the string and \r\n, both or neither
+  using    Print::println;
+  int      availableForWrite();
+  uint16_t Dropped();        // bytes dropped since boot, saturates
+  size_t   PrintLine(const char *Format, ...)  // printf one line and \r\n, formatted on the stack, one write
+           __attribute__((format(printf, 2, 3)));
+ private:
+  uint16_t DroppedBytes = 0;
+};
+extern UiOutClass UiOut;
+
+// Line source for bulk output, fills Line with line Index, returns false past the last line
+typedef bool (*UiLine_t)(uint8_t Index, char *Line);
+
+// Write lines from Source, starting at Index, while they fit
+// Returns true when the last line is out, else call again with the same Index on a later pass
+bool UiOutLines(UiLine_t Source, uint8_t &Index);
+
+#endif
@@ -7,5 +7,6 @@
 
 // public functions
 void UserConfig(sConfig_t * pConfig);
+void UserConfigSync(const sConfig_t &Config);  // config replaced outside the UI, HostLink set-config
 
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+// Hardware abstraction, ATtiny1616 under megaTinyCore
+// Timer tick, key pin change interrupts, cycle counter, reset and stack measurement
+// Not built for [env:native], see src/native/HalNative.cpp
+
+#include "Hal.h"
+#include "SequencerStateMachine.h"
+#include <avr/sleep.h>
+
+#if !( defined(MEGATINYCORE) )
+  #error Written for megaTinyCore, ATtiny1616
+#endif
+
+// Sequencer tick on TCB1, periodic interrupt mode clocked from TCA0, F_CPU/8
+// CNT restarts in hardware at each compare, the period is exact with no
+// correction factor, and HalTickSet() can change or stop it from an interrupt
+// TCA0 must be running, HalCycleInit() before HalTickInit()
+static void (*TickCallback)();
+
+void HalTickInit(void (*Callback)()) {
+  TickCallback  = Callback;
+  TCB1.CTRLB    = TCB_CNTMODE_INT_gc;
+  TCB1.INTCTRL  = TCB_CAPT_bm;
+  HalTickSet(TIMER1_INTERVAL_MS);
+}
+
+void HalTickSet(uint8_t Interval_ms) {
+  TCB1.CTRLA    = 0;                    // stopped
+  TCB1.INTFLAGS = TCB_CAPT_bm;
+  if (Interval_ms == 0) {
+    return;
+  }
+  TCB1.CNT      = 0;
+  TCB1.CCMP     = (uint16_t) (Interval_ms * HALTICKS_PER_MSEC - 1);
+  TCB1.CTRLA    = TCB_CLKSEL_CLKTCA_gc | TCB_ENABLE_bm;
+}
+
+ISR(TCB1_INT_vect) {
+  TCB1.INTFLAGS = TCB_CAPT_bm;
+  TickCallback();
+}
+
+// Interrupt on both edges of Key and RTS, keep the pullups
+// Called after GlobalConf is loaded, the interrupt runs the state machine
+void HalKeyEdgesInit() {
+  KEYPORT.INTFLAGS   = KEYPIN_bm;
+  RTSPORT.INTFLAGS   = RTSPIN_bm;
+  KEYPORT.KEYPINCTRL = PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc;
+  RTSPORT.RTSPINCTRL = PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc;
+}
+
+ISR(PORTC_PORT_vect) {  // KEYPIN
+  KEYPORT.INTFLAGS = KEYPIN_bm;
+  KeyEdgeISR();
+}
+
+ISR(PORTA_PORT_vect) {  // RTSPIN
+  RTSPORT.INTFLAGS = RTSPIN_bm;
+  KeyEdgeISR();
+}
+
+// TCA0 is free, millis() is on TCD0 and nothing uses PWM
+// Take it from the core, normal mode, count the full 16 bits
+// The overflow interrupt counts the upper 16 bits for HalTime()
+// HalTime() replaces millis() from here on, so the millis() timer is stopped,
+// its interrupt would wake HalIdle() every msec, delay() is only used before this
+static volatile uint16_t CycleHigh;
+
+void HalCycleInit() {
+#ifndef MILLIS_USE_TIMERNONE
+  stop_millis();
+#endif
+  takeOverTCA0();
+  TCA0.SINGLE.CTRLB   = TCA_SINGLE_WGMODE_NORMAL_gc;
+  TCA0.SINGLE.PER     = 0xFFFF;
+  TCA0.SINGLE.CNT     = 0;
+  TCA0.SINGLE.INTCTRL = TCA_SINGLE_OVF_bm;
+  TCA0.SINGLE.CTRLA   = TCA_SINGLE_CLKSEL_DIV8_gc | TCA_SINGLE_ENABLE_bm;
+}
+
+ISR(TCA0_OVF_vect) {
+  TCA0.SINGLE.INTFLAGS = TCA_SINGLE_OVF_bm;
+  CycleHigh++;
+}
+
+// an overflow not yet taken by the interrupt, a low count means it is already in Low
+HalTime_t HalTime() {
+  uint8_t Sreg = SREG;
+  cli();
+  uint16_t Low  = TCA0.SINGLE.CNT;
+  uint16_t High = CycleHigh;
+  if ((TCA0.SINGLE.INTFLAGS & TCA_SINGLE_OVF_bm) && (Low < 0x8000)) {
+    High++;
+  }
+  SREG = Sreg;
+  return ((uint32_t) High << 16) | Low;
+}
+
+// Tx timeout on the RTC, free running from the 32.768 kHz internal oscillator
+// prescaled to HALTIMEOUT_PER_SEC, the 16 bit count wraps every 512 sec
+// Arm moves the compare Seconds ahead, one count more so it never expires early,
+// the interrupt checks the count as well, a match on the old compare while the
+// new one syncs to the RTC clock, about 60 usec, is not taken for expiry
+// CNT and CMP have their own TEMP register, read and write with interrupts off
+static volatile bool     TimeoutArmed;
+static volatile uint16_t TimeoutAt;     // RTC count at expiry
+
+static uint16_t RtcCount() {
+  uint8_t Sreg = SREG;
+  cli();
+  uint16_t Count = RTC.CNT;
+  SREG = Sreg;
+  return Count;
+}
+
+void HalTimeoutInit() {
+  while (RTC.STATUS) {}                 // registers synced
+  RTC.CLKSEL  = RTC_CLKSEL_INT32K_gc;
+  RTC.PER     = 0xFFFF;
+  RTC.INTCTRL = 0;
+  RTC.CTRLA   = RTC_PRESCALER_DIV256_gc | RTC_RTCEN_bm;
+}
+
+void HalTimeoutArm(uint8_t Seconds) {
+  uint8_t Sreg = SREG;
+  cli();
+  RTC.INTCTRL  = 0;
+  TimeoutAt    = RTC.CNT + (uint16_t) Seconds * HALTIMEOUT_PER_SEC + 1;
+  while (RTC.STATUS & RTC_CMPBUSY_bm) {}  // only after an arm in the last 60 usec
+  RTC.CMP      = TimeoutAt;
+  RTC.INTFLAGS = RTC_CMP_bm;
+  TimeoutArmed = true;
+  RTC.INTCTRL  = RTC_CMP_bm;
+  SREG = Sreg;
+}
+
+void HalTimeoutStop() {
+  RTC.INTCTRL  = 0;
+  TimeoutArmed = false;
+}
+
+uint16_t HalTimeoutLeft() {
+  int16_t Left = (int16_t) (TimeoutAt - RtcCount());
+  return (TimeoutArmed && (Left > 0)) ? (uint16_t) Left : 0;
+}
+
+ISR(RTC_CNT_vect) {
+  RTC.INTFLAGS = RTC_CMP_bm;
+  if (!TimeoutArmed || ((int16_t) (RTC.CNT - TimeoutAt) < 0)) {
+    return;
+  }
+  HalTimeoutStop();
+  TxTimeoutISR();
+}
+
+// IDLE sleep, every peripheral and interrupt keeps running, any interrupt wakes it:
+// serial RX, key and RTS edges, step deadline, sequencer tick, Tx timeout and the
+// TCA0 overflow every HALCYCLE_WRAPMSEC, which stays as HalTime() counts its upper 16 bits
+// STANDBY would stop the USART clock and TCA0, so it is not used
+// sei() holds off interrupts for one instruction, so input that arrives after
+// the check still wakes the sleep instead of waiting for the next interrupt
+void HalIdle() {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  if (Serial.available() == 0) {
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+  }
+  sei();
+}
+
+void HalReset() {
+  _PROTECTED_WRITE(RSTCTRL.SWRR, 1);
+}
+
+// Stack high water mark
+// setup() paints the free RAM between the end of .bss and the stack pointer
+// StackUnused() counts painted bytes the stack has never reached
+#define STACKPAINT 0xA5
+extern uint8_t __heap_start;  // linker symbol, end of .bss, no heap in use
+
+void StackPaint() {
+  uint8_t *p = &__heap_start;
+  while (p < (uint8_t *) SP - 8) {  // margin below this function's frame
+    *p++ = STACKPAINT;
+  }
+}
+
+uint16_t StackUnused() {
+  const uint8_t *p = &__heap_start;
+  uint16_t Count = 0;
+  while ((p < (const uint8_t *) SP) && (*p == STACKPAINT)) {
+    p++;
+    Count++;
+  }
+  return Count;
+}
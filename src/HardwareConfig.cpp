@@ -10,7 +10,7 @@ void InitPins() {
   pinMode(LEDPIN, OUTPUT);
   pinMode(CTSPIN, OUTPUT);
   digitalWrite(LEDPIN, HIGH);
-  digitalWrite(CTSPIN, LOW);
+  digitalWrite(CTSPIN, CTS_DOWN);  // up only in Tx
 
   pinMode(S1T_PIN, OUTPUT);
   pinMode(S2T_PIN, OUTPUT);
@@ -23,4 +23,4 @@ void InitPins() {
   pinMode(XTRA4PIN, OUTPUT);
   pinMode(XTRA5PIN, OUTPUT);
   pinMode(XTRA6PIN, OUTPUT);
-}
\ No newline at end of file
+}
@@ -0,0 +1,223 @@
+// Serial input demux, text lines and binary host frames
+// Replaces the serial-readline library, which read every byte as text
+// Only loop() calls in here, replies go out through UiOut and never block
+
+#include "HostLink.h"
+#include "HardwareConfig.h"
+#include "SoftwareConfig.h"
+#include "SequencerStateMachine.h"
+#include "Stats.h"
+#include "UiOut.h"
+#include "UserInterface.h"
+#include "Hal.h"
+#include <CRC.h>
+
+#define LINK_LINELEN 40  // longest text line kept, UserInterface.cpp Line[]
+
+// text line being assembled
+static char    Text[LINK_LINELEN];
+static uint8_t TextLen;
+static bool    TextLong;   // ran past LINK_LINELEN, the line is reported and dropped
+static bool    TextReady;  // line ended, waiting for HostLinkReadLine()
+
+// frame being received, the bytes after LINK_SYNC
+static uint8_t       Frame[LINK_MAXLEN + 4];  // Len, Cmd, Payload, CRC16
+static uint8_t       FrameCount;
+static bool          InFrame;
+static HalTime_t     FrameStart;      // HalTime() at LINK_SYNC
+static uint16_t      LinkErrors;
+
+static void LinkSend(uint8_t Cmd, const void *Payload, uint8_t Len) {
+  uint8_t Out[LINK_OVERHEAD + LINK_MAXLEN];
+  Out[0] = LINK_SYNC;
+  Out[1] = Len;
+  Out[2] = Cmd;
+  if (Len) {
+    memcpy(&Out[3], Payload, Len);
+  }
+  uint16_t CRC = calcCRC16(&Out[1], Len + 2);
+  Out[Len + 3] = CRC & 0xFF;
+  Out[Len + 4] = CRC >> 8;
+  UiOut.write(Out, Len + LINK_OVERHEAD);  // whole frame or nothing
+}
+
+static void CountError() {
+  if (LinkErrors != 0xFFFF) {
+    LinkErrors++;
+  }
+}
+
+static void LinkNak(uint8_t Err) {
+  CountError();
+  LinkSend(LINK_NAK, &Err, 1);
+}
+
+// same checks as the user interface, polarity is OPEN or CLOSED
+// the first and last steps are serial
+static bool LinkConfigValid(const sConfig_t &Config) {
+  if (!isConfigValid(Config) || (Config.Timeout > TIMEOUTMAX) || (Config.KeyAlive > KEYALIVEMAX) ||
+      (Config.KeyAssert > KEYFILTERMAX) || (Config.KeyRelease > KEYFILTERMAX) ||
+      (Config.Step[0].Start_100us != STEPSERIAL) || (Config.Step[NSTEPS - 1].Start_100us != STEPSERIAL)) {
+    return false;
+  }
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    if ((Config.Step[k].RxPolarity != OPEN) && (Config.Step[k].RxPolarity != CLOSED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void LinkCommand(uint8_t Cmd, const uint8_t *Payload, uint8_t Len, sConfig_t *pConfig) {
+  switch (Cmd) {
+    case LINK_GETCONFIG: {
+      if (Len != 0) {
+        break;
+      }
+      sConfig_t Config = *pConfig;  // a user interface edit leaves the CRC for CommitConfig()
+      Config.CRC16 = CalcCRC(Config);
+      LinkSend(Cmd | LINK_REPLY, &Config, sizeof(Config));
+      return;
+    }
+
+    case LINK_SETCONFIG: {
+      if (Len != sizeof(sConfig_t)) {
+        break;
+      }
+      sConfig_t Config;
+      memcpy(&Config, Payload, sizeof(Config));
+      if (!LinkConfigValid(Config)) {
+        LinkNak(LINK_ERR_CONFIG);
+        return;
+      }
+      *pConfig = Config;          // same path as a user interface edit
+      MarkConfigDirty(CONF_ALL);
+      PublishConfig(Config);
+      UserConfigSync(Config);
+      LinkSend(Cmd | LINK_REPLY, NULL, 0);
+      return;
+    }
+
+    case LINK_GETSTATUS: {
+      if (Len != 0) {
+        break;
+      }
+      sLinkStatus_t Status;
+      Status.State         = (uint8_t) StateMachineState();
+      Status.Dirty         = ConfigDirtyFields();
+      Status.KeyLatency    = KeyLatency();
+      Status.MaxKeyLatency = MaxKeyLatency();
+      Status.StackUnused   = StackUnused();
+      Status.Dropped       = UiOut.Dropped();
+      Status.LinkErrors    = LinkErrors;
+      Status.KeyExpiries   = SerialKeyExpiries();
+      Status.KeyGlitches   = KeyGlitches();
+      Status.TxTimeouts    = TxTimeouts();
+      Status.TxTimeoutLeft = TxTimeoutLeft();
+      Status.MaxCTSLatency = MaxCTSLatency();
+      LinkSend(Cmd | LINK_REPLY, &Status, sizeof(Status));
+      return;
+    }
+
+    case LINK_GETSTATS: {
+      if (Len != 0) {
+        break;
+      }
+      sStats_t Stats[STAT_COUNT];
+      for (uint8_t Id = 0; Id < STAT_COUNT; Id++) {
+        StatsGet(Id, Stats[Id]);
+      }
+      LinkSend(Cmd | LINK_REPLY, Stats, sizeof(Stats));
+      return;
+    }
+
+    default:
+      LinkNak(LINK_ERR_COMMAND);
+      return;
+  }
+  LinkNak(LINK_ERR_LENGTH);
+}
+
+static void FrameByte(uint8_t b, sConfig_t *pConfig) {
+  Frame[FrameCount++] = b;
+  uint8_t Len = Frame[0];
+  if (Len > LINK_MAXLEN) {
+    InFrame = false;
+    LinkNak(LINK_ERR_LENGTH);
+    return;
+  }
+  if (FrameCount < Len + 4) {
+    return;
+  }
+  InFrame = false;
+  uint16_t CRC = Frame[Len + 2] | (Frame[Len + 3] << 8);
+  if (calcCRC16(Frame, Len + 2) != CRC) {
+    LinkNak(LINK_ERR_CRC);
+    return;
+  }
+  LinkCommand(Frame[1], &Frame[2], Len, pConfig);
+}
+
+static void TextByte(char c) {
+  if ((c == '\r') || (c == '\n')) {
+    TextReady = (TextLen > 0) || TextLong;  // skip empty lines and the \n of \r\n
+    return;
+  }
+  if (TextLen < LINK_LINELEN) {
+    Text[TextLen++] = c;
+  } else {
+    TextLong = true;
+  }
+}
+
+// Reads until a text line is complete, so typed input stays in order behind it
+// Key bytes are taken even then, the line only holds back text and frames
+// A frame is only read with room for the largest reply, else it waits in the RX ring
+void HostLinkPoll(sConfig_t *pConfig) {
+  if (InFrame && !Serial.available() && (HalTime() - FrameStart > LINK_TIMEOUTMS * HALTIME_PER_MSEC)) {
+    InFrame = false;  // host gave up mid frame
+    CountError();
+  }
+  while (Serial.available()) {
+    uint8_t b = (uint8_t) Serial.peek();
+    if (!InFrame && ((b == LINK_KEYDOWN) || (b == LINK_KEYUP))) {
+      Serial.read();
+      SerialKey(b == LINK_KEYDOWN);
+      continue;
+    }
+    if (TextReady) {
+      break;
+    }
+    if ((InFrame || (b == LINK_SYNC)) &&
+        (UiOut.availableForWrite() < LINK_OVERHEAD + LINK_MAXLEN)) {
+      break;
+    }
+    Serial.read();
+    if (InFrame) {
+      FrameByte(b, pConfig);
+    } else if (b == LINK_SYNC) {
+      InFrame         = true;
+      FrameCount      = 0;
+      FrameStart      = HalTime();
+    } else {
+      TextByte((char) b);
+    }
+  }
+}
+
+uint8_t HostLinkReadLine(char *Line, uint8_t Size) {
+  if (!TextReady) {
+    return 0;
+  }
+  uint8_t Len = TextLen;
+  if (TextLong || (Len >= Size)) {
+    Len = Size;
+  } else {
+    memcpy(Line, Text, Len);
+    Line[Len] = '\0';
+  }
+  TextLen   = 0;
+  TextLong  = false;
+  TextReady = false;
+  return Len;
+}
@@ -24,270 +24,615 @@
 //             [unkey]                  [key]                     
 //                  \                   /
 //                   <--(    Tx     )<--        
+//
+// Drawn for 4 steps, the transitions come from sSeqTable in SequencerTable.h
+// which builds the same chains for NSTEPS steps at compile time
 
 #include "SequencerStateMachine.h"
+#include "Hal.h"
 #include "HardwareConfig.h"         // pick up pin names
+#include "SequencerTable.h"
+#include "StepTimer.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "Global.h"
 
 // Private to StateMachine functions
-// State Machine definitions
-enum         State_t           {  Rx,   S1T,     S2T,     S3T,     S4T,    Tx,   S4R,     S3R,     S2R,     S1R    }; // numbered 0 to 9
-const uint8_t StepIdx[]      = {   9,     0,       1,       2,       3,     9,     3,       2,       1,       0    }; // index into Config.Step[] array
-const char*  StateName[][10] = {" Rx", "S1T",   "S2T",   "S3T",   "S4T", " Tx", "S4R",   "S3R",   "S2R",   "S1R"   }; // for debug messages
-uint8_t      StepPin[]       = {   0,   S1T_PIN, S2T_PIN, S3T_PIN, S4T_PIN, 0,   S4R_PIN, S3R_PIN, S2R_PIN, S1R_PIN}; // map state to hardware pin
+// State Machine definitions, transition table built at compile time
+// for NSTEPS steps and the StepPinMap in HardwareConfig.h
+typedef sSeqTable<NSTEPS, StepPinMap> SeqTable_t;
+static const SeqTable_t Table PROGMEM = SeqTable_t();
+static_assert((SeqTable_t::Rx == STATE_RX) && (SeqTable_t::Tx == STATE_TX), "STATE_RX, STATE_TX");
+static_assert((TICK_RX_MS <= HALTICK_MAXMSEC) && (TICK_STEP_MS <= HALTICK_MAXMSEC) &&
+              (TICK_TX_MS <= HALTICK_MAXMSEC), "TICK_ longer than the tick timer");
 
-// private functions
-void   newStateMsg(sConfig_t Config, State_t prevState, State_t State, int StepTime);
-State_t StateTimer(sConfig_t Config, State_t prevState, State_t State, State_t nextState, int TimeLoop);
+// Row fields read from flash
+#define ROW(State, Field) pgm_read_byte(&Table.Row[State].Field)
 
-// Called from an timer interrupt
-void SequencerISR() {
-  #ifdef DEBUG
-  digitalWrite(XTRA6PIN, HIGH);
-  #endif
-  static long          TxTimer_msec; 
-  int                  TimeIncrement;
-  unsigned long        TimeNow;
-  static unsigned long TimePrevious = millis(); // initialize
-  bool KeyTimeOut; // used by Tx timout management in loop()
+// Rx image of the step bits in each port, the port level of every step in Rx
+// XOR with a row's Assert bits gives the image for that state
+struct sPortImage_t {
+  uint8_t A;
+  uint8_t B;
+  uint8_t C;
+};
+
+// Config banks, the ISR runs on ConfBank[ActiveBank] and its RxImage[ActiveBank]
+// PublishConfig() fills the other bank from loop(), then sets PublishedBank
+// The ISR switches ActiveBank to PublishedBank only when the next pass is Rx,
+// so every sequence runs on one consistent snapshot, PublishConfig() switches
+// it itself when the machine is resting in Rx
+static sConfig_t        ConfBank[2];
+static sPortImage_t     RxImage[2];
+static volatile uint8_t ActiveBank    = 0;  // written only by the ISR
+static volatile uint8_t PublishedBank = 0;  // written only by PublishConfig()
+
+// Global sequencer state machine variables
+static State_t State     = SeqTable_t::Rx;
+static State_t prevState = SeqTable_t::Tx;
+static State_t nextState = SeqTable_t::Rx;
+
+// Tx timeout, the RTC watchdog in the HAL is armed on the first key input and
+// stopped when all are released, TxTimeoutISR() sets KeyTimeOut at expiry
+static bool     KeyTimeOut;
+static bool     KeyAsserted;            // any key input, before the timeout
+static uint16_t TxTimeoutCount;         // timeouts since boot
+
+// CTS, ready to modulate, up only in Tx with Config.CTSEnable
+// It goes up Config.CTSLead after Tx entry, timed on the step timer
+// A key release or timeout drops it on that pass, before any relay moves,
+// then the relays hold Config.CTSLag in Tx, also on the step timer
+static bool          CTSUp;
+static bool          CTSLeadPending;    // in Tx, CTS goes up at the step deadline
+static bool          CTSLagPending;     // in Tx with the key released, relays wait for the deadline
+static HalTime_t     PassStart;         // HalTime() at the start of the interrupt running the machine
+static unsigned int  LastCTSLatency_usec;
+static unsigned int  MaxCTSLatency_usec;
+
+// Tick rate, TickForState() after every pass
+static uint8_t       Tick_ms = TIMER1_INTERVAL_MS;  // as started by HalTickInit()
+static HalTime_t     TickPrevious;                  // HalTime() at the previous tick
+static bool          TickStarted;                   // first tick since HalTickInit() has no previous
+
+// Relay progress toward Tx, one per step
+// Pos is 0 at rest in Rx, STEPPOS_FULL fully asserted, as of Move
+// Dir is the way the relay has moved since, at the rate set by the step time,
+// it stops at either end. Entering SkT or SkR starts relay k's move, so relays
+// started with a Start_100us offset keep moving through the states after theirs
+// FASTABORT keeps the part of a move a relay made when it turns back,
+// without it every move starts from the far end
+#define STEPPOS_FULL 0xFFFF
+#define HALTIME_PER_UNIT (HALTIME_PER_MSEC / STEPUNITS_PER_MSEC)  // Config step time unit
+static_assert(HALTIME_PER_MSEC % STEPUNITS_PER_MSEC == 0, "step unit is not whole HalTime() counts");
+struct sRelay_t {
+  uint16_t  Pos;
+  int8_t    Dir;      // 1 toward Tx, -1 toward Rx, 0 at rest
+  HalTime_t Move;     // HalTime() when the move started
+  HalTime_t Done;     // HalTime() when it ends
+};
+static sRelay_t Relay[NSTEPS];
+
+// KEYPIN integrating filter, Config.KeyAssert and KeyRelease
+// Acc counts HalTime() of the pin away from the filtered key, and back down while it agrees
+// The key changes when Acc reaches the threshold, a pulse that drains to 0 first is a glitch
+static bool          FilterKey;         // filtered KEYPIN, positive true
+static bool          FilterPin;         // pin level since the last sample
+static HalTime_t     FilterLast;        // HalTime() of the last sample
+static HalTime_t     FilterAcc;
+static uint16_t      FilterGlitches;    // rejected since boot
+
+// In-band key from the serial port, SerialKey() from loop(), dead-man timer in the tick
+static volatile bool SerialKeyed;
+static long          SerialAlive;       // HalTime() counts, key drops when this runs out
+static uint16_t      SerialKeyExpired;  // dead-man drops since boot
+
+// Key to output latency, edge timestamp resolved when the state machine leaves EdgeState
+static volatile HalTime_t     KeyEdge;
+static volatile State_t       EdgeState;
+static volatile bool          KeyPending = false;
+static unsigned int           LastKeyLatency_usec;
+static unsigned int           MaxKeyLatency_usec;
+
+// Build the Rx image from the step polarities
+static void BuildRxImage(const sConfig_t &Config, sPortImage_t *pImage) {
+  pImage->A = 0;
+  pImage->B = 0;
+  pImage->C = 0;
+  for (uint8_t Step = 0; Step < NSTEPS; Step++) {
+    if (Config.Step[Step].RxPolarity) {
+      pImage->A |= StepPinMap::A[Step];
+      pImage->B |= StepPinMap::B[Step];
+      pImage->C |= StepPinMap::C[Step];
+    }
+  }
+}
+
+// Config for this interrupt, switches to a published bank on the way into Rx
+static const sConfig_t &RunConfig() {
+  if ((nextState == SeqTable_t::Rx) && (PublishedBank != ActiveBank)) {
+    ActiveBank = PublishedBank;
+  }
+  return ConfBank[ActiveBank];
+}
 
-  TimeNow = millis();
-  TimeIncrement = (unsigned int)(TimeNow - TimePrevious);
-  TimePrevious = TimeNow;
+// Drive all step outputs and XTRA mirrors to the image for State
+static inline void ApplyOutputs(State_t State) {
+  const sPortImage_t *pImage = &RxImage[ActiveBank];
+  HalStepOutputs(pImage->A ^ ROW(State, AssertA),
+                 pImage->B ^ ROW(State, AssertB),
+                 pImage->C ^ ROW(State, AssertC));
+}
+
+// Hand a new config to the sequencer ISR
+// Called from setup() and the user interface after each config change
+// Retract any publication the ISR has not taken yet and pick the other bank
+// with interrupts off, an ISR switch between the two would leave Bank running,
+// then fill the bank with interrupts on and publish it
+// Idle in Rx no interrupt may come until the next key edge, TICK_RX_MS 0,
+// so the bank is taken and the Rx outputs driven here, with interrupts off
+void PublishConfig(const sConfig_t &Config) {
+  noInterrupts();
+  PublishedBank = ActiveBank;  // retract, ISR sees nothing new
+  uint8_t Bank = !ActiveBank;
+  interrupts();
+  ConfBank[Bank] = Config;
+  BuildRxImage(Config, &RxImage[Bank]);
+  __asm__ __volatile__ ("" ::: "memory");  // bank stores complete before publishing
+  noInterrupts();
+  PublishedBank = Bank;
+  if ((State == SeqTable_t::Rx) && (nextState == SeqTable_t::Rx)) {
+    RunConfig();
+    ApplyOutputs(State);
+  }
+  interrupts();
+}
 
+// Called on every key sample, tick, pin edge or step deadline
+// The pin holds its level between samples, each edge is a sample with KEYEDGEISR,
+// so the integral is exact, a threshold is seen at the next tick, TICK_STEP_MS
+static bool KeyFilter(const sConfig_t &Config, bool Pin) {
+  HalTime_t Now  = HalTime();
+  HalTime_t Held = Now - FilterLast;
+  FilterLast = Now;
+  if (FilterPin != FilterKey) {
+    FilterAcc += Held;
+  } else if (FilterAcc > Held) {
+    FilterAcc -= Held;
+  } else if (FilterAcc != 0) {
+    FilterAcc = 0;
+    KeyPending = false;             // no state change is coming for this edge
+    if (FilterGlitches != 0xFFFF) {
+      FilterGlitches++;
+    }
+    TraceAdd(TRACE_GLITCH, FilterKey);
+  }
+  FilterPin = Pin;
+  HalTime_t Threshold = (HalTime_t) (FilterKey ? Config.KeyRelease : Config.KeyAssert) * HALTIME_PER_MSEC;
+  if ((FilterPin != FilterKey) && (FilterAcc >= Threshold)) {
+    FilterKey = FilterPin;
+    FilterAcc = 0;
+  }
+  return FilterKey;
+}
+
+// Read the Key and RTS pins and the serial key, arm or stop the Tx timeout
+// Elapsed HalTime() counts since the last tick, 0 from the other interrupts
+// Returns Key used by the state machine
+static bool SequencerKey(const sConfig_t &Config, HalTime_t Elapsed) {
   // Convert Key input to positive true logic
-  uint8_t KeyPin = digitalRead(KEYPIN);  // low when opto led on
+  uint8_t KeyPin = HalKeyPin();  // low when opto led on
   uint8_t KeyPositive = !KeyPin; // MCU Pin state, Opto off, pin pulled up, Opto ON causes low
   
   // Convert RTS input to positive true logic
-  bool RTSPin = digitalRead(RTSPIN);
+  bool RTSPin = HalRTSPin();
   bool RTSPositive = !RTSPin;  // key if RTS UP, meaning RTS/ and MCU pin low
   
-  bool KeyState = KeyPositive; // hardware Key interface, high = asserted
-  bool RTSState = GlobalConf.RTSEnable & RTSPositive; // USB serial key interface, high = asserted
+  bool KeyState = KeyFilter(Config, KeyPositive); // hardware Key interface, high = asserted
+  bool RTSState = Config.RTSEnable & RTSPositive; // USB serial key interface, high = asserted
+
+  // in-band serial key, dropped if the host stops refreshing it
+  if (SerialKeyed) {
+    SerialAlive -= (long) Elapsed;
+    if ((SerialAlive <= 0) || (Config.KeyAlive == 0)) {
+      SerialKeyed = false;
+      if (SerialKeyExpired != 0xFFFF) {
+        SerialKeyExpired++;
+      }
+      TraceAdd(TRACE_TIMEOUT, TRACETO_KEYALIVE);
+    }
+  }
+  bool SerialState = SerialKeyed;
+  bool WasAsserted = KeyAsserted;
+  KeyAsserted = KeyState | RTSState | SerialState;
   
-  // reset the timeout timer is unkeyed
-  if (!KeyState & !RTSState) {  // if unkeyed, reset the tx timeout timer
-    TxTimer_msec = (long) GlobalConf.Timeout * 1000; //sec to msec
+  // the timeout runs from the first key input until all are released
+  if (!KeyAsserted) {
+    if (WasAsserted) {
+      HalTimeoutStop();
+    }
     KeyTimeOut = false;
-  } else {
-    TxTimer_msec -= (long) TimeIncrement;
+  } else if (!WasAsserted && (Config.Timeout != 0)) {  // timeout = 0 means disable timeout
+    HalTimeoutArm(Config.Timeout);
   }
-  
-  // if Tx timer timeout, set KeyTimeOut flag
-  if (TxTimer_msec <= 0) {
-    TxTimer_msec = 0;               // keep timer from underflowing
-    KeyTimeOut = true;
+
+  // used by state machine, key in OR RTS OR serial AND NOT timeout
+  return KeyAsserted & !KeyTimeOut;
+}
+
+// after a state machine pass, close out a pending key edge measurement
+static void KeyLatencyCheck(State_t State) {
+  if (KeyPending && (State != EdgeState)) {
+    uint32_t Latency = HalTimeToUsec(HalTime() - KeyEdge);
+    LastKeyLatency_usec = (Latency > 0xFFFF) ? 0xFFFF : (unsigned int) Latency;
+    if (LastKeyLatency_usec > MaxKeyLatency_usec) {
+      MaxKeyLatency_usec = LastKeyLatency_usec;
+    }
+    KeyPending = false;
   }
-  bool isTimerDisabled = (GlobalConf.Timeout == 0);  // timeout = 0 means disable timeout
+}
 
-  // used by state machine, combined from hardware and timeout
-  bool Key;
-  if (isTimerDisabled){
-    Key = (KeyState | RTSState);
+// Run the pending transition and the new state's entry in one interrupt
+// entry drives the step output and arms the step deadline
+// A step with nothing left to wait is done at entry, the next one is entered now
+static void SequencerStep(const sConfig_t &Config, bool Key) {
+  State_t Entered;
+  do {
+    StateMachine(Config, Key);                  // transition sets nextState
+    Entered = StateMachine(Config, Key);        // enter nextState, drive its output
+    KeyLatencyCheck(Entered);
+  } while (nextState != Entered);
+}
+
+// Tick for the state the machine will run next, TICK_ settings
+// A tick started from stopped counts the timeout from now
+static void TickForState() {
+  uint8_t Want;
+  if ((FilterPin != FilterKey) || (FilterAcc != 0)) {
+    Want = TICK_STEP_MS;                           // key filter integrating
+  } else if ((nextState == SeqTable_t::Rx) && !KeyAsserted) {
+    Want = TICK_RX_MS;
+  } else if ((nextState == SeqTable_t::Rx) || (nextState == SeqTable_t::Tx)) {
+    Want = (KEYEDGEISR && !SerialKeyed) ? 0 : TICK_TX_MS;  // keyed, or timed out with the key held
   } else {
-    Key = (KeyState | RTSState) & !KeyTimeOut;  // key in OR RTS AND NOT timeout
+    Want = TICK_STEP_MS;
+  }
+  if (Want != Tick_ms) {
+    if (Tick_ms == 0) {
+      TickPrevious = HalTime();
+    }
+    Tick_ms = Want;
+    HalTickSet(Want);
+  }
+}
+
+// Called from the tick interrupt, TICK_ rate for the state
+// Runs the serial key dead-man and a backstop key sample, step timing is in
+// StepDeadlineISR(), the Tx timeout in TxTimeoutISR()
+void SequencerISR() {
+  uint16_t Start = HalCycles();
+  #ifdef DEBUG
+  digitalWrite(XTRA6PIN, HIGH);
+  #endif
+  HalTime_t Now = HalTime();
+  PassStart = Now;
+  if (!TickStarted) {
+    TickStarted  = true;
+    TickPrevious = Now;
   }
+  HalTime_t Elapsed = Now - TickPrevious;  // exact, the remainder is not lost to msec rounding
+  TickPrevious = Now;
 
-  digitalWrite(XTRA6PIN, Key);
-  StateMachine(GlobalConf, Key, TimeIncrement);
+  const sConfig_t &Config = RunConfig();
+  bool Key = SequencerKey(Config, Elapsed);
+
+  HalKeyIndicator(Key);
+  SequencerStep(Config, Key);         // a key change the filter let through is entered now, as from an edge
+  TickForState();
   #ifdef DEBUG
   digitalWrite(XTRA6PIN, LOW);
   #endif
+  StatsAdd(STAT_ISR, Start);
 }
 
-// Commom state timer and state transition function
-// Called from each state of state machine every time through loop()
-// On first call to state, set the timer and assert the step output
-// Returns State for next pass, either same State or StateNew
-// Leave State unchanged if timer still running
-// nextState returned when time completes 
-// Timer set from table of assert and release times for each step
-
-// detect is this is the first call after state change
-//   initialize the timer based on state
-//   run the timer on the current state
-// when timer completes, return the new state
-// Parameters
-//  Config: polarity of step pins
-//  prevState, State: detect when a new state
-//  nextState: for when timer timesout
-//  TimeLoop: time between calls to statemachine, used to decrement timer
-//  StepPin: pin controlled by next state
-State_t StateTimer (sConfig_t Config, State_t prevState, State_t State, State_t nextState, int TimeLoop) {
-  static int StepTime;
-  // State change on this pass
-  if (prevState != State) { 
-    if ((State >= S1T) & (State <= S4T)) { // States for transition from Rx to Tx 
-      digitalWrite(StepPin[State], !Config.Step[StepIdx[State]].RxPolarity);
-      StepTime = Config.Step[StepIdx[State]].Tx_msec;             // initialize the timer
-    }    
-    if ((State >= S4R) & (State <= S1R)) {                   // States for transition from Tx to Rx
-      digitalWrite(StepPin[State],  Config.Step[StepIdx[State]].RxPolarity);
-      StepTime = Config.Step[StepIdx[State]].Rx_msec;             // initialize the timer
+// Called from the KEYPIN and RTSPIN pin change interrupts, HalKeyEdgesInit()
+// Timestamps the edge for the latency measurement
+// With KEYEDGEISR, runs the key transition and the new state's entry now
+// instead of waiting up to two timer ticks
+void KeyEdgeISR() {
+  uint16_t Start = HalCycles();
+  KeyEdge      = HalTime();
+  PassStart    = KeyEdge;
+  EdgeState    = StateMachineState();
+  KeyPending   = true;
+  TraceAdd(TRACE_KEY, (HalKeyPin() ? 0 : TRACEKEY_PIN) | (HalRTSPin() ? 0 : TRACEKEY_RTS) |
+                      (SerialKeyed ? TRACEKEY_SERIAL : 0));
+  #if KEYEDGEISR
+  const sConfig_t &Config = RunConfig();
+  bool Key = SequencerKey(Config, 0);
+  HalKeyIndicator(Key);
+  SequencerStep(Config, Key);
+  TickForState();
+  #endif
+  StatsAdd(STAT_ISR, Start);
+}
+
+// In-band key byte, from HostLinkPoll() in loop()
+// Key down starts or restarts the Config.KeyAlive window, ignored when it is 0
+// A change runs the same path as a key pin edge, with interrupts off
+void SerialKey(bool Keyed) {
+  noInterrupts();
+  const sConfig_t &Config = RunConfig();
+  if (Config.KeyAlive != 0) {
+    SerialAlive = (long) Config.KeyAlive * HALTIME_PER_MSEC;
+    if (Keyed != SerialKeyed) {
+      SerialKeyed = Keyed;
+      KeyEdgeISR();
     }
-    #ifdef DEBUG
-      newStateMsg(Config, prevState, State, StepTime);         // debug message
-    #endif
-  } // if state change 
+  }
+  interrupts();
+}
 
-  StepTime -= TimeLoop;
+uint16_t SerialKeyExpiries() {
+  return SerialKeyExpired;
+}
+
+uint16_t KeyGlitches() {
+  return FilterGlitches;
+}
 
-  if (StepTime <= 0) {  // timer running, check for timeout
-    State = nextState;
+// Called once from the RTC interrupt, Config.Timeout sec after the first key input
+// Drops the key until every key input is released, the sequence runs down now
+void TxTimeoutISR() {
+  uint16_t Start = HalCycles();
+  PassStart  = HalTime();
+  KeyTimeOut = true;
+  if (TxTimeoutCount != 0xFFFF) {
+    TxTimeoutCount++;
   }
-  return State;
-} // StateTimer()
-
-#ifdef DEBUG
-// common message function for all states
-void newStateMsg(sConfig_t Config, State_t prevState, State_t State, int StepTime) {
-  if ((State == Rx) | State == Tx) {
-    char Msg[80];
-    snprintf(Msg, 80, "State from %s to %s", StateName[0][prevState], StateName[0][State]);
-    Serial.println(Msg); 
+  TraceAdd(TRACE_TIMEOUT, TRACETO_TX);
+  const sConfig_t &Config = RunConfig();
+  bool Key = SequencerKey(Config, 0);
+  HalKeyIndicator(Key);
+  SequencerStep(Config, Key);
+  TickForState();
+  StatsAdd(STAT_ISR, Start);
+}
+
+uint16_t TxTimeouts() {
+  return TxTimeoutCount;
+}
+
+// tenths of a second to the Tx timeout, 0 when it is not running
+uint16_t TxTimeoutLeft() {
+  return (uint16_t) (((uint32_t) HalTimeoutLeft() * 10 + HALTIMEOUT_PER_SEC - 1) / HALTIMEOUT_PER_SEC);
+}
+
+// Called from the step timer interrupt at the exact end of the current step
+void StepDeadlineISR() {
+  uint16_t Start = HalCycles();
+  PassStart = HalTime();
+  const sConfig_t &Config = RunConfig();
+  SequencerStep(Config, SequencerKey(Config, 0));
+  TickForState();
+  StatsAdd(STAT_ISR, Start);
+}
+
+// latest and worst case key edge to state change, usec
+unsigned int KeyLatency() {
+  return LastKeyLatency_usec;
+}
+
+unsigned int MaxKeyLatency() {
+  return MaxKeyLatency_usec;
+}
+
+// latest and worst case start of the interrupt that dropped the key to CTS down, usec
+unsigned int CTSLatency() {
+  return LastCTSLatency_usec;
+}
+
+unsigned int MaxCTSLatency() {
+  return MaxCTSLatency_usec;
+}
+
+// state name from its table row, Rx, Tx, SnT or SnR, Name holds 6
+void StateName(State_t State, char *Name) {
+  if (State == SeqTable_t::Rx) {
+    strcpy(Name, "Rx");
+  } else if (State == SeqTable_t::Tx) {
+    strcpy(Name, "Tx");
   } else {
-    char Msg[80];
-    snprintf(Msg, 80, "State from %s to %s, timer %d msec", StateName[0][prevState], StateName[0][State], StepTime);
-    Serial.println(Msg);
+    snprintf(Name, 6, "S%d%c", ROW(State, Step) + 1, ROW(State, KeyHold) ? 'T' : 'R');
+  }
+}
+
+// state the machine will run on its next pass
+State_t StateMachineState() {
+  return nextState;
+}
+
+#if FASTABORT
+// Position of relay k at Now
+static uint16_t RelayPos(const sConfig_t &Config, uint8_t k, HalTime_t Now) {
+  const sRelay_t &R = Relay[k];
+  if (R.Dir == 0) {
+    return R.Pos;
   }
-} // StateEntryMessage
+  uint32_t Units = (Now - R.Move) / HALTIME_PER_UNIT;
+  uint32_t Time  = (R.Dir > 0) ? Config.Step[k].Tx_100us : Config.Step[k].Rx_100us;
+  uint32_t Moved = (Units >= Time) ? STEPPOS_FULL : Units * STEPPOS_FULL / Time;
+  if (R.Dir > 0) {
+    return (R.Pos + Moved > STEPPOS_FULL) ? STEPPOS_FULL : R.Pos + Moved;
+  }
+  return (R.Pos > Moved) ? R.Pos - Moved : 0;
+}
 #endif
 
-// States are numbered 0 to 9 by an enum function
-// State 0, Rx
-// States 1:4, transition from Rx to Tx
-// State 5, Tx
-// State 9:6, transition from Tx to Rx
-void StateMachine(sConfig_t Config, bool Key, int TimeLoop) {
-// Global sequencer state machine variables
-  static State_t State     = Rx;
-  static State_t prevState = Tx;
-  static State_t nextState;
+// Step time units until relay k reaches the end it is moving to, rounded up
+static uint16_t RelayLeft(uint8_t k, HalTime_t Now) {
+  int32_t Left = (int32_t) (Relay[k].Done - Now);  // signed across the wrap
+  if ((Relay[k].Dir == 0) || (Left <= 0)) {
+    return 0;
+  }
+  return (uint16_t) ((Left + HALTIME_PER_UNIT - 1) / HALTIME_PER_UNIT);
+}
 
-  prevState = State;
-  State = nextState; 
-  switch (State) {
-    case Rx: 
-      // lock in the receive state on every pass
-      digitalWrite(S1T_PIN, (uint8_t) GlobalConf.Step[0].RxPolarity); // config as receive mode 
-      digitalWrite(S2T_PIN, (uint8_t) GlobalConf.Step[1].RxPolarity); // config as receive mode 
-      digitalWrite(S3T_PIN, (uint8_t) GlobalConf.Step[2].RxPolarity); // config as receive mode 
-      digitalWrite(S4T_PIN, (uint8_t) GlobalConf.Step[3].RxPolarity); // config as receive mode 
-
-      #ifdef DEBUG
-      if (prevState != State) {  // first time looping through Rx state
-        newStateMsg(Config, prevState, State, 0); // State debug with no timer
-      }
-      #endif
-      // watch for Key asserted, and transition to first Tx state
-      if (Key) { // Keyed
-        //Serial.println("State Rx, key asserted");  
-        nextState =  S1T;
-      } // keyed
-      break;
-    // manage step 1 relay during Rx to Tx sequence
-    case S1T:
-      if (Key) { // if keyed, check timer and need for next state
-        nextState = StateTimer(Config, prevState, State, S2T, TimeLoop); 
-        digitalWrite(XTRA1PIN, !Config.Step[S1T- S1T].RxPolarity);
-      } else { // if not keyed, transition to corresponding Rx transition state
-        nextState = S1R;
-      }
-      break;
+// Longest RelayLeft() of relays 0 to Last
+static uint16_t RelaysLeft(uint8_t Last, HalTime_t Now) {
+  uint16_t Most = 0;
+  for (uint8_t k = 0; k <= Last; k++) {
+    uint16_t Left = RelayLeft(k, Now);
+    Most = (Left > Most) ? Left : Most;
+  }
+  return Most;
+}
 
-    // manage step 2 relay during Rx to Tx sequence
-    case S2T:
-      if (Key) {
-        digitalWrite(XTRA2PIN, !Config.Step[S2T- S1T].RxPolarity);
-        nextState = StateTimer(Config, prevState, State, S3T, TimeLoop);
-      } else {
-        nextState = S2R;
-      }
-      break;
+// Start relay k toward Tx, Dir 1, or Rx, Dir -1
+static void RelayMove(const sConfig_t &Config, uint8_t k, int8_t Dir, HalTime_t Now) {
+  #if FASTABORT
+  uint16_t Pos = RelayPos(Config, k, Now);
+  #else
+  uint16_t Pos = (Dir > 0) ? 0 : STEPPOS_FULL;
+  #endif
+  uint16_t Left = (Dir > 0) ? STEPPOS_FULL - Pos : Pos;
+  uint32_t Time = (Dir > 0) ? Config.Step[k].Tx_100us : Config.Step[k].Rx_100us;
+  uint32_t Units = (Time * Left + STEPPOS_FULL - 1) / STEPPOS_FULL;
+  Relay[k].Pos  = Pos;
+  Relay[k].Dir  = Dir;
+  Relay[k].Move = Now;
+  Relay[k].Done = Now + Units * HALTIME_PER_UNIT;
+}
 
-    // manage step 3 relay during Rx to Tx sequence
-    case S3T: 
-      if (Key) {
-        digitalWrite(XTRA3PIN, !Config.Step[S3T - S1T].RxPolarity);
-        nextState = StateTimer(Config, prevState, State, S4T, TimeLoop);
-      } else {
-        nextState =  S3R;
-      }
-      break;
+// Rx and Tx are only entered with every relay at that end, so no move is timed
+// across a long stay there, HalTime() wraps every HALTIME_WRAPSEC
+static void RelaysAt(uint16_t Pos) {
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Relay[k].Pos = Pos;
+    Relay[k].Dir = 0;           // RelayPos() holds, RelayLeft() is 0
+  }
+}
 
-    // manage step 4 relay during Rx to Tx sequence
-    case S4T: 
-      if (Key) {
-        digitalWrite(XTRA4PIN, !Config.Step[S4T - S1T].RxPolarity);
-        nextState =  StateTimer(Config, prevState, State, Tx, TimeLoop);
-      } else {
-        nextState =  S4R;
-      }
-      break;
-
-    case Tx: 
-      if (prevState != State) {
-        #ifdef DEBUG
-        newStateMsg(Config, prevState, State, 0);
-        #endif
-        // TODO, if Config.CTSEnable...
-        //digitalWrite(CTSPIN, CTS_UP);
-      }
-      if (!Key) { // watch for release of key
-        nextState =  S4R;
-        digitalWrite(CTSPIN, CTS_DOWN);
-      }
-      break;
+// Entering stepping State, start its relay, returns the time to the next state
+// Forward, SkT lasts until step k + 1 starts, SnT until relay n is done
+// Reverse mirrors it, SkR lasts until step k - 1 starts its release, S1R until every
+// relay is back. Start_100us of step k sets when it starts after step k - 1,
+// and when step k - 1 starts its release after step k
+// The last step is serial both ways, it starts when all relays before it are done,
+// and the others start their release when it is back
+static uint16_t StepWait(const sConfig_t &Config, State_t State) {
+  uint8_t   k   = ROW(State, Step);
+  HalTime_t Now = HalTime();
+  if (ROW(State, KeyHold)) {
+    RelayMove(Config, k, 1, Now);
+    if (k == NSTEPS - 1) {
+      return RelayLeft(k, Now);
+    }
+    if (k + 1 == NSTEPS - 1) {
+      return RelaysLeft(k, Now);
+    }
+    uint16_t Start = Config.Step[k + 1].Start_100us;
+    return (Start == STEPSERIAL) ? RelayLeft(k, Now) : Start;
+  }
+  RelayMove(Config, k, -1, Now);
+  if (k == 0) {
+    return RelaysLeft(NSTEPS - 1, Now);
+  }
+  uint16_t Start = Config.Step[k].Start_100us;
+  if ((k == NSTEPS - 1) || (Start == STEPSERIAL)) {
+    return RelayLeft(k, Now);
+  }
+  return Start;
+}
 
-    // manage step 4 relay during Tx to Rx sequence
-    case S4R:  // step 4 release timing
-      if (!Key) {
-        nextState = StateTimer(Config, prevState, State, S3R, TimeLoop);
-        digitalWrite(XTRA4PIN, Config.Step[S1R - S4R].RxPolarity);
+// CTS up, now or Config.CTSLead after Tx entry
+static void CTSRaise() {
+  CTSLeadPending = false;
+  CTSUp = true;
+  HalCTS(CTS_UP);
+  TraceAdd(TRACE_CTS, 1);
+}
 
-      } else {
-        nextState =  S4T;
-      }
-      break;
+// Key dropped in Tx, CTS down first, then the relays may release
+// Returns true when Tx can be left now, false to hold for Config.CTSLag
+static bool TxLeave(const sConfig_t &Config) {
+  CTSLeadPending = false;             // dropped before CTS was up, nothing to guard
+  if (CTSUp) {
+    HalCTS(CTS_DOWN);
+    CTSUp = false;
+    TraceAdd(TRACE_CTS, 0);
+    uint32_t Latency = HalTimeToUsec(HalTime() - PassStart);
+    LastCTSLatency_usec = (Latency > 0xFFFF) ? 0xFFFF : (unsigned int) Latency;
+    if (LastCTSLatency_usec > MaxCTSLatency_usec) {
+      MaxCTSLatency_usec = LastCTSLatency_usec;
+    }
+    if (Config.CTSLag != 0) {
+      CTSLagPending = true;
+      StepTimerArm(MSEC_TO_STEPTICKS(Config.CTSLag));
+      return false;
+    }
+  }
+  if (CTSLagPending && !StepTimerDone()) {
+    return false;
+  }
+  CTSLagPending = false;
+  return true;
+}
 
-    // manage step 3 relay during Tx to Rx sequence
-    case S3R: 
-      if (!Key) {
-        nextState = StateTimer(Config, prevState, State, S2R, TimeLoop);
-        digitalWrite(XTRA3PIN, Config.Step[S1R - S3R].RxPolarity);
-      } else {
-        nextState =  S3T;
-      }
-      break;
+// Table driven state machine, one pass
+// States are numbered by sSeqTable, Rx, S1T to SnT, Tx, SnR to S1R
+// Key != KeyHold: leave at once for OnChange, the matching state in the other chain
+// Key == KeyHold:
+//   first pass in the state, drive its output image and arm its step deadline
+//   timed states go to OnTimer when the deadline is reached
+//   Rx locks in the receive outputs on every pass
+//   Tx raises CTS, at entry or after Config.CTSLead
+// Leaving Tx drops CTS first, and holds the relays Config.CTSLag after it
+// Config is read in place through a const reference, never copied in the ISR
+// Returns the State run on this pass
+State_t StateMachine(const sConfig_t &Config, bool Key) {
+  prevState = State;
+  State = nextState;
 
-    // manage step 2 relay during Tx to Rx sequence
-    case S2R: 
-      if (!Key) {
-        nextState = StateTimer(Config, prevState, State, S1R, TimeLoop);
-        digitalWrite(XTRA2PIN, Config.Step[S1R - S2R].RxPolarity);
-      } else {
-        nextState =  S2T;
-      }
-      break;
+  if (Key != ROW(State, KeyHold)) {   // key changed, reverse direction now
+    if ((State != SeqTable_t::Tx) || TxLeave(Config)) {
+      nextState = ROW(State, OnChange);
+    }
+    return State;
+  }
 
-    // manage step 1 relay during Tx to Rx sequence
-    case S1R: 
-      if (!Key) {
-        nextState = StateTimer(Config, prevState, State, Rx, TimeLoop);
-        digitalWrite(XTRA1PIN, Config.Step[S1R - S1R].RxPolarity);
+  uint8_t Step = ROW(State, Step);
+  if (prevState != State) {           // entry
+    ApplyOutputs(State);              // step outputs and XTRA mirrors for this state
+    TraceAdd(TRACE_STATE, State);
+    uint16_t StepTime = 0;
+    if (Step != NOSTEP) {
+      StepTime = StepWait(Config, State);
+      StepTimerArm(UNITS_TO_STEPTICKS(StepTime));  // replaces any deadline still pending
+    } else {
+      RelaysAt((State == SeqTable_t::Tx) ? STEPPOS_FULL : 0);
+    }
+    if ((State == SeqTable_t::Tx) && Config.CTSEnable) {
+      if (Config.CTSLead == 0) {
+        CTSRaise();
       } else {
-        nextState =  S1T;
+        CTSLeadPending = true;
+        StepTimerArm(MSEC_TO_STEPTICKS(Config.CTSLead));
       }
-      break;
-
-    default:
-      #ifdef DEBUG
-      Serial.print("State: default, Error");
-      Serial.print(" state ");
-      Serial.print(State);
-      Serial.println();
-      #endif
-      break;
-  } 
+    }
+  } else if (State == SeqTable_t::Rx) {
+    ApplyOutputs(State);              // lock in the receive state, picks up polarity changes
+  } else if (State == SeqTable_t::Tx) {
+    if (CTSLagPending) {              // key back during the lag, relays never moved
+      CTSLagPending = false;
+      StepTimerArm(0);
+      CTSRaise();
+    } else if (CTSLeadPending && StepTimerDone()) {
+      CTSRaise();
+    }
+  }
+
+  if ((Step != NOSTEP) && StepTimerDone()) {  // deadline reached
+    nextState = ROW(State, OnTimer);
+  }
+  return State;
 }
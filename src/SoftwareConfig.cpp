@@ -7,34 +7,259 @@
 #include "Config.h"
 #include "SoftwareConfig.h"
 #include "HardwareConfig.h"
+#include "Hal.h"
+#include "UiOut.h"
 #include "Global.h"
 
 // Config structure functions
 // read, write, put, verify, print
 
-// Read Config from EEPROM
-sConfig_t GetConfig(uint8_t address) {
-  sConfig_t EEConf;
-  EEPROM.get(address, EEConf);
-  return EEConf;
+// Journal record, one per EEPROM slot
+// Conf_t is sConfig_t, or an older layout read for migration
+template <typename Conf_t>
+struct __attribute__((packed)) sJournalRecOf_t {
+  uint16_t  Seq;      // commit sequence number, wraps, newest is highest
+  uint8_t   Version;  // JOURNALVERSION when written
+  Conf_t    Config;   // carries its own CRC16 too
+  uint16_t  CRC16;    // covers Seq, Version and Config
+};
+typedef sJournalRecOf_t<sConfig_t> sJournalRec_t;
+#define JOURNALSLOTS ((E2END + 1) / sizeof(sJournalRec_t))
+
+// journal position, found by GetConfig(), advanced by PutConfig()
+static uint8_t  JournalSlot = JOURNALSLOTS - 1; // slot of newest record, first write goes to slot 0
+static uint16_t JournalSeq  = 0;                // sequence number of newest record
+
+template <typename Rec_t>
+static uint16_t CalcRecCRC(const Rec_t &Rec) {
+  return calcCRC16((const uint8_t*) &Rec, sizeof(Rec) - sizeof(Rec.CRC16));
+}
+
+template <typename Conf_t>
+static bool isConfCRCValid(const Conf_t &Config) {
+  return calcCRC16((const uint8_t*) &Config, sizeof(Config) - sizeof(Config.CRC16)) == Config.CRC16;
+}
+
+// Newest valid record of one version, slots of sizeof(Rec_t)
+// Scans each slot once, returns false if there is none
+template <typename Rec_t>
+static bool JournalNewest(uint8_t Version, Rec_t &Newest, uint16_t &Addr) {
+  Rec_t Rec;
+  bool  Found = false;
+  for (uint16_t a = 0; a + sizeof(Rec_t) <= E2END + 1; a += sizeof(Rec_t)) {
+    EEPROM.get(a, Rec);
+    if ((Rec.Version != Version) || (Rec.CRC16 != CalcRecCRC(Rec))) {
+      continue;  // erased, torn or another version
+    }
+    // sequence compare survives wrap, records are at most one ring apart
+    if (!Found || ((int16_t) (Rec.Seq - Newest.Seq) > 0)) {
+      Found  = true;
+      Newest = Rec;
+      Addr   = a;
+    }
+  }
+  return Found;
+}
+
+// Older layouts, one version up at a time, CRC16 is set on the last step
+// The V03STEPS steps of V0.3 keep their places and the last, the transmitter,
+// stays last, steps of a longer table between them take no time
+static sConfigV2_t UpgradeV1(const sConfigV1_t &Old) {
+  sConfigV2_t Config;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    if (k == NSTEPS - 1) {
+      Config.Step[k] = Old.Step[V03STEPS - 1];
+    } else if (k < V03STEPS - 1) {
+      Config.Step[k] = Old.Step[k];
+    } else {
+      Config.Step[k].RxPolarity = OPEN;
+      Config.Step[k].Tx_msec    = 0;
+      Config.Step[k].Rx_msec    = 0;
+    }
+  }
+  Config.RTSEnable = Old.RTSEnable;
+  Config.CTSEnable = Old.CTSEnable;
+  Config.Timeout   = Old.Timeout;
+  Config.KeyAlive  = 0;               // in-band serial keying off
+  return Config;
+}
+
+static sConfigV3_t UpgradeV2(const sConfigV2_t &Old) {
+  sConfigV3_t Config;
+  for (uint8_t k = 0; k < NSTEPS; k++) {  // msec to 100 usec units
+    Config.Step[k].RxPolarity = Old.Step[k].RxPolarity;
+    Config.Step[k].Tx_100us   = Old.Step[k].Tx_msec * STEPUNITS_PER_MSEC;
+    Config.Step[k].Rx_100us   = Old.Step[k].Rx_msec * STEPUNITS_PER_MSEC;
+  }
+  Config.RTSEnable = Old.RTSEnable;
+  Config.CTSEnable = Old.CTSEnable;
+  Config.Timeout   = Old.Timeout;
+  Config.KeyAlive  = Old.KeyAlive;
+  return Config;
+}
+
+static sConfigV4_t UpgradeV3(const sConfigV3_t &Old) {
+  sConfigV4_t Config;
+  memcpy(Config.Step, Old.Step, sizeof(Config.Step));
+  Config.RTSEnable  = Old.RTSEnable;
+  Config.CTSEnable  = Old.CTSEnable;
+  Config.Timeout    = Old.Timeout;
+  Config.KeyAlive   = Old.KeyAlive;
+  Config.KeyAssert  = 0;              // key filter off, keys on the first edge as before
+  Config.KeyRelease = 0;
+  return Config;
+}
+
+static sConfigV5_t UpgradeV4(const sConfigV4_t &Old) {
+  sConfigV5_t Config;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Config.Step[k].RxPolarity  = Old.Step[k].RxPolarity;
+    Config.Step[k].Tx_100us    = Old.Step[k].Tx_100us;
+    Config.Step[k].Rx_100us    = Old.Step[k].Rx_100us;
+    Config.Step[k].Start_100us = STEPSERIAL;  // one step after another, as before
+  }
+  Config.RTSEnable  = Old.RTSEnable;
+  Config.CTSEnable  = Old.CTSEnable;
+  Config.Timeout    = Old.Timeout;
+  Config.KeyAlive   = Old.KeyAlive;
+  Config.KeyAssert  = Old.KeyAssert;
+  Config.KeyRelease = Old.KeyRelease;
+  return Config;
+}
+
+static sConfig_t UpgradeV5(const sConfigV5_t &Old) {
+  sConfig_t Config;
+  memcpy(Config.Step, Old.Step, sizeof(Config.Step));
+  Config.RTSEnable  = Old.RTSEnable;
+  Config.CTSEnable  = Old.CTSEnable;
+  Config.Timeout    = (Old.Timeout > TIMEOUTMAX) ? TIMEOUTMAX : Old.Timeout;  // older firmware took 65535
+  Config.KeyAlive   = Old.KeyAlive;
+  Config.KeyAssert  = Old.KeyAssert;
+  Config.KeyRelease = Old.KeyRelease;
+  Config.CTSLead    = 0;              // CTS with Tx, relays release with CTS, as before
+  Config.CTSLag     = 0;
+  Config.CRC16      = CalcCRC(Config);
+  return Config;
+}
+
+// Write a migrated config as the first current record
+// Continues the old sequence, in the first slot clear of the old record's bytes
+static void JournalUpgrade(const sConfig_t &Config, uint16_t Seq, uint16_t OldAddr, uint8_t OldSize) {
+  uint8_t Slot = 0;
+  while ((Slot < JOURNALSLOTS - 1) &&
+         (Slot * sizeof(sJournalRec_t) < OldAddr + OldSize) &&
+         ((Slot + 1) * sizeof(sJournalRec_t) > OldAddr)) {
+    Slot++;
+  }
+  JournalSlot = (Slot == 0) ? JOURNALSLOTS - 1 : Slot - 1;  // PutConfig() takes the next
+  JournalSeq  = Seq;
+  PutConfig(Config);
+}
+
+// Read newest valid Config from the EEPROM journal
+// Older layouts are converted and written back as a current record, once
+// Returns a config failing isConfigValid() when EEPROM holds none, for the caller
+sConfig_t GetConfig() {
+  sJournalRec_t Rec  = {};
+  uint16_t      Addr = 0;
+  JournalSlot = JOURNALSLOTS - 1;
+  JournalSeq  = 0;
+  if (JournalNewest(JOURNALVERSION, Rec, Addr)) {
+    JournalSlot = Addr / sizeof(sJournalRec_t);
+    JournalSeq  = Rec.Seq;
+    return Rec.Config;                  // written bounded, UpgradeV5() or an input check
+  }
+
+  sConfig_t Config;
+  sJournalRecOf_t<sConfigV5_t> RecV5;
+  sJournalRecOf_t<sConfigV4_t> RecV4;
+  sJournalRecOf_t<sConfigV3_t> RecV3;
+  sJournalRecOf_t<sConfigV2_t> RecV2;
+  sJournalRecOf_t<sConfigV1_t> RecV1;
+  sConfigV1_t                  V03;
+  if (JournalNewest(5, RecV5, Addr) && isConfCRCValid(RecV5.Config)) {
+    Config = UpgradeV5(RecV5.Config);
+    JournalUpgrade(Config, RecV5.Seq, Addr, sizeof(RecV5));
+  } else if (JournalNewest(4, RecV4, Addr) && isConfCRCValid(RecV4.Config)) {
+    Config = UpgradeV5(UpgradeV4(RecV4.Config));
+    JournalUpgrade(Config, RecV4.Seq, Addr, sizeof(RecV4));
+  } else if (JournalNewest(3, RecV3, Addr) && isConfCRCValid(RecV3.Config)) {
+    Config = UpgradeV5(UpgradeV4(UpgradeV3(RecV3.Config)));
+    JournalUpgrade(Config, RecV3.Seq, Addr, sizeof(RecV3));
+  } else if (JournalNewest(2, RecV2, Addr) && isConfCRCValid(RecV2.Config)) {
+    Config = UpgradeV5(UpgradeV4(UpgradeV3(UpgradeV2(RecV2.Config))));
+    JournalUpgrade(Config, RecV2.Seq, Addr, sizeof(RecV2));
+  } else if (JournalNewest(1, RecV1, Addr) && isConfCRCValid(RecV1.Config)) {
+    Config = UpgradeV5(UpgradeV4(UpgradeV3(UpgradeV2(UpgradeV1(RecV1.Config)))));
+    JournalUpgrade(Config, RecV1.Seq, Addr, sizeof(RecV1));
+  } else if (isConfCRCValid(EEPROM.get(0, V03))) {  // V0.3 single copy at address 0
+    Config = UpgradeV5(UpgradeV4(UpgradeV3(UpgradeV2(UpgradeV1(V03)))));
+    JournalUpgrade(Config, 0, 0, sizeof(V03));
+  } else {
+    memset(&Config, 0xFF, sizeof(Config));  // as erased
+    Config.CRC16 = ~CalcCRC(Config);
+  }
+  return Config;
 }
 
-// Update Config in EEPROM
-// compare new config with eeprom and update bytes as necessary
-void PutConfig(uint8_t address, sConfig_t EEConf) {
-  // update the CRC
-  EEConf.CRC16 = CalcCRC(EEConf);
-  EEPROM.put(address, EEConf);
+// Write Config to the slot after the newest
+// EEConf.CRC16 is written as it is, every caller has just set it with CalcCRC()
+// EEPROM.put() skips bytes that already match
+// Previous record stays intact until the next JOURNALSLOTS - 1 writes
+void PutConfig(const sConfig_t &EEConf) {
+  sJournalRec_t Rec;
+  Rec.Seq          = JournalSeq + 1;
+  Rec.Version      = JOURNALVERSION;
+  Rec.Config       = EEConf;
+  Rec.CRC16        = CalcRecCRC(Rec);
+
+  uint8_t Slot = JournalSlot + 1;
+  if (Slot >= JOURNALSLOTS) {
+    Slot = 0;
+  }
+  EEPROM.put(Slot * sizeof(sJournalRec_t), Rec);
+  JournalSlot = Slot;
+  JournalSeq  = Rec.Seq;
   return;
 }
 
-bool isConfigValid(sConfig_t Config) {
+bool isConfigValid(const sConfig_t &Config) {
   uint16_t CRCTest = CalcCRC(Config);
   return (CRCTest == Config.CRC16);
 }
 
-uint16_t CalcCRC(sConfig_t Config) {
-  return calcCRC16((uint8_t*) &Config, sizeof(Config) - sizeof(Config.CRC16));
+uint16_t CalcCRC(const sConfig_t &Config) {
+  return calcCRC16((const uint8_t*) &Config, sizeof(Config) - sizeof(Config.CRC16));
+}
+
+// Deferred commit state, only touched from loop()
+static uint16_t  DirtyFields = 0;  // CONF_ bits edited since last commit
+static HalTime_t LastEdit;         // HalTime() of most recent edit
+
+// called by the user interface after each edit
+void MarkConfigDirty(uint16_t Fields) {
+  DirtyFields |= Fields;
+  LastEdit = HalTime();
+}
+
+uint16_t ConfigDirtyFields() {
+  return DirtyFields;
+}
+
+// Called from loop() every pass
+// idle path is a single test of DirtyFields
+// returns true if the config was written to EEPROM
+bool CommitConfig(sConfig_t *pConfig, bool Force) {
+  if (DirtyFields == 0) {
+    return false;  // nothing edited, no CRC, no EEPROM reads
+  }
+  if (!Force && ((HalTime() - LastEdit) < COMMITQUIETMS * HALTIME_PER_MSEC)) {
+    return false;  // user still editing, coalesce into one write
+  }
+  pConfig->CRC16 = CalcCRC(*pConfig);  // in place, no copy
+  PutConfig(*pConfig);
+  DirtyFields = 0;
+  return true;
 }
 
 // Default configuration, executed from Setup(), if necessary
@@ -43,70 +268,83 @@ uint16_t CalcCRC(sConfig_t Config) {
 // delays specifiec in msec after key asserted
 sConfig_t InitDefaultConfig() {
   sConfig_t Config;
-  Config.Step[0].RxPolarity = OPEN;    // closed on Tx, open on Rx, closed by driving pin high
-  Config.Step[0].Tx_msec    = 75;           // msec relay assert time
-  Config.Step[0].Rx_msec    = 75;           // msec relay release time
-  Config.Step[1].RxPolarity = OPEN;
-  Config.Step[1].Tx_msec    = 75;
-  Config.Step[1].Rx_msec    = 75;
-  Config.Step[2].RxPolarity = OPEN;
-  Config.Step[2].Tx_msec    = 75;
-  Config.Step[2].Rx_msec    = 75;
-  Config.Step[3].RxPolarity = OPEN;
-  Config.Step[3].Tx_msec    = 75;
-  Config.Step[3].Rx_msec    = 75;
+  for (uint8_t ii = 0; ii < NSTEPS; ii++) {
+    Config.Step[ii].RxPolarity = OPEN;  // closed on Tx, open on Rx, closed by driving pin high
+    Config.Step[ii].Tx_100us   = 75 * STEPUNITS_PER_MSEC;  // relay assert time, 75 msec
+    Config.Step[ii].Rx_100us   = 75 * STEPUNITS_PER_MSEC;  // relay release time
+    Config.Step[ii].Start_100us = STEPSERIAL;             // after the step before is done
+  }
   Config.RTSEnable          = false;        // RTS UP to key Tx
   Config.CTSEnable          = false;        // CTS UP on ready to modulate
   Config.Timeout            = 120;          // sec, 0 means disabled
+  Config.KeyAlive           = 0;            // msec, in-band serial keying off
+  Config.KeyAssert          = 0;            // msec, key filter off
+  Config.KeyRelease         = 0;
+  Config.CTSLead            = 0;            // msec, CTS up on Tx entry
+  Config.CTSLag             = 0;            // msec, relays release as CTS drops
   Config.CRC16              = CalcCRC(Config);
-
-  PrintConfig(Config);
   return Config;
 }
 
-// pretty print the memory configuration on serial port
-void PrintConfig(sConfig_t Config) {
-  char Msg[80];
-  Serial.println("Tiny Sequencer, V0.3 Config");
-  for(int ii = 0; ii < 4; ii++) {
-    char Polarity_str[15] = "              ";
-    if (Config.Step[ii].RxPolarity == OPEN) {
-      strcpy(Polarity_str, "OPEN on RX");
+// One line of the config printout, Line holds UIOUT_LINELEN
+// Returns false past the last line
+bool ConfigLine(const sConfig_t &Config, uint8_t Index, char *Line) {
+  if (Index == 0) {
+    strcpy(Line, "Tiny Sequencer, V0.6 Config");
+  } else if (Index <= NSTEPS) {
+    uint8_t ii = Index - 1;
+    uint16_t Tx = Config.Step[ii].Tx_100us;
+    uint16_t Rx = Config.Step[ii].Rx_100us;
+    uint8_t  n  = snprintf(Line, UIOUT_LINELEN, "Step %d, Contacts %s, TX delay %u.%u, RX delay %u.%u", ii,
+                           (Config.Step[ii].RxPolarity == OPEN) ? "OPEN on RX" : "CLOSED on RX",
+                           Tx / STEPUNITS_PER_MSEC, Tx % STEPUNITS_PER_MSEC,
+                           Rx / STEPUNITS_PER_MSEC, Rx % STEPUNITS_PER_MSEC);
+    uint16_t Start = Config.Step[ii].Start_100us;
+    if ((Start != STEPSERIAL) && (ii > 0) && (ii < NSTEPS - 1) && (n < UIOUT_LINELEN)) {
+      snprintf(Line + n, UIOUT_LINELEN - n, ", start +%u.%u", Start / STEPUNITS_PER_MSEC,
+               Start % STEPUNITS_PER_MSEC);
+    }
+  } else if (Index == NSTEPS + 1) {
+    snprintf(Line, UIOUT_LINELEN, "RTS   %s, ", Config.RTSEnable ? "Enabled" : "Disabled");
+  } else if (Index == NSTEPS + 2) {
+    if (Config.CTSEnable) {
+      snprintf(Line, UIOUT_LINELEN, "CTS   Enabled, up %u msec after Tx, relays hold %u msec after down",
+               Config.CTSLead, Config.CTSLag);
     } else {
-      strcpy(Polarity_str, "CLOSED on RX");
+      strcpy(Line, "CTS   Disabled");
     }
-    snprintf(Msg, 80, "Step %d, Contacts %s, TX delay %d, RX delay %d", ii, Polarity_str, Config.Step[ii].Tx_msec, Config.Step[ii].Rx_msec);
-    Serial.println(Msg);
-  }
-
-  Serial.print("RTS   ");
-  if (Config.RTSEnable == true){
-    Serial.print("Enabled, ");
-  } else {
-    Serial.print("Disabled, ");
-  }
-  Serial.println();
-
-  Serial.print("CTS   ");
-  if (Config.CTSEnable == true){
-    Serial.print("Enabled");
+  } else if (Index == NSTEPS + 3) {
+    if (Config.Timeout == 0) {
+      strcpy(Line, "Tx Timer Disabled");
+    } else {
+      snprintf(Line, UIOUT_LINELEN, "Tx Timer %u sec", (unsigned int) Config.Timeout);
+    }
+  } else if (Index == NSTEPS + 4) {
+    if (Config.KeyAlive == 0) {
+      strcpy(Line, "Serial key Disabled");
+    } else {
+      snprintf(Line, UIOUT_LINELEN, "Serial key alive %u msec", (unsigned int) Config.KeyAlive);
+    }
+  } else if (Index == NSTEPS + 5) {
+    if ((Config.KeyAssert == 0) && (Config.KeyRelease == 0)) {
+      strcpy(Line, "Key filter Disabled");
+    } else {
+      snprintf(Line, UIOUT_LINELEN, "Key filter assert %u msec, release %u msec",
+               Config.KeyAssert, Config.KeyRelease);
+    }
+  } else if (Index == NSTEPS + 6) {
+    snprintf(Line, UIOUT_LINELEN, "CRC %X", (unsigned int) Config.CRC16);  // DEBUG
   } else {
-    Serial.print("Disabled");
+    return false;
   }
-  Serial.println();
+  return true;
+}
 
-  Serial.print("Tx Timer ");
-  unsigned int Timeout = Config.Timeout;
-  if (Timeout == 0) {
-    Serial.println("Disabled");
-  } else {
-    Serial.print(Timeout);
-    Serial.println(" sec");
+// pretty print the memory configuration on serial port
+// blocks until sent, for setup(), the user interface pages it with UiOutLines()
+void PrintConfig(const sConfig_t &Config) {
+  char Line[UIOUT_LINELEN];
+  for (uint8_t Index = 0; ConfigLine(Config, Index, Line); Index++) {
+    Serial.println(Line);
   }
-
-  // DEBUG
-  Serial.print("CRC ");
-  Serial.print(Config.CRC16, HEX);
-  Serial.println();
-
 } // PrintConfig()
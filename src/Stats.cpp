@@ -0,0 +1,147 @@
+// Execution time stats
+// SequencerISR() and loop() bracket their work with HalCycles() and add the time here
+// Records are updated from interrupts, so loop() copies or clears them with
+// interrupts off
+
+#include "Stats.h"
+#include "Hal.h"
+#include "UiOut.h"
+#include "SequencerStateMachine.h"
+
+static sStats_t Stats[STAT_COUNT];
+
+static const char * const StatName[STAT_COUNT] = {"ISR", "Loop"};
+
+// sleep accounting, loop() only, no interrupt masking
+// 32 bits, all three halve together before Total passes half its range,
+// 14 minutes in a class, the rates and the ratio stay as they were
+struct sWake_t {
+  uint32_t Wakes;
+  uint32_t Sleep;   // HalTime() counts asleep
+  uint32_t Total;   // HalTime() counts in the class
+};
+static sWake_t  Wake[WAKE_COUNT];
+static HalTime_t LastWake; // HalTime() at the previous StatsIdle()
+
+static const char * const WakeName[WAKE_COUNT] = {"Rx", "Step", "Tx"};
+
+static void StatsRecord(uint8_t Id, uint32_t usec) {
+  sStats_t *p = &Stats[Id];
+  uint16_t Time = (usec > 0xFFFF) ? 0xFFFF : (uint16_t) usec;
+  uint8_t  Bin  = 0;
+  while ((Bin < STATBINS - 1) && (Time >> (Bin + 1))) {
+    Bin++;
+  }
+  if ((p->Count == 0) || (Time < p->Min)) {
+    p->Min = Time;
+  }
+  if (Time > p->Max) {
+    p->Max = Time;
+  }
+  if (p->Bin[Bin] != 0xFFFF) {
+    p->Bin[Bin]++;
+  }
+  p->Sum += usec;
+  p->Count++;
+}
+
+void StatsAdd(uint8_t Id, uint16_t Start) {
+  uint16_t Cycles = HalCycles() - Start;
+  StatsRecord(Id, (uint32_t) Cycles * HALCYCLE_NSEC / 1000);
+}
+
+// HalCycles() wraps every HALCYCLE_WRAPMSEC, HalTime() carries the span past it
+void StatsAddLong(uint8_t Id, HalTime_t Start) {
+  StatsRecord(Id, HalTimeToUsec(HalTime() - Start));
+}
+
+void StatsReset() {
+  noInterrupts();
+  memset(Stats, 0, sizeof(Stats));
+  interrupts();
+  memset(Wake, 0, sizeof(Wake));
+  LastWake = HalTime();
+}
+
+// the time since the previous wake goes to the class the sequencer is in now
+void StatsIdle(HalTime_t SleepStart) {
+  HalTime_t Now  = HalTime();
+  State_t  State = StateMachineState();
+  uint8_t  Class = (State == STATE_RX) ? WAKE_RX : (State == STATE_TX) ? WAKE_TX : WAKE_SEQ;
+  sWake_t *p = &Wake[Class];
+  if (p->Total & 0x80000000UL) {
+    p->Wakes >>= 1;
+    p->Sleep >>= 1;
+    p->Total >>= 1;
+  }
+  p->Wakes++;
+  p->Sleep += Now - SleepStart;
+  p->Total += Now - LastWake;
+  LastWake  = Now;
+}
+
+// Part / Whole in permille, Part <= Whole, 32 bit math
+static uint16_t Permille(uint32_t Part, uint32_t Whole) {
+  while (Whole > 0xFFFFFFFFUL / 1000) {
+    Part  >>= 1;
+    Whole >>= 1;
+  }
+  return (uint16_t) (Part * 1000 / Whole);
+}
+
+static void WakeLine(uint8_t Class, char *Line) {
+  const sWake_t *p = &Wake[Class];
+  if (p->Total == 0) {
+    snprintf(Line, UIOUT_LINELEN, "%-4s sleep, no time in state", WakeName[Class]);
+    return;
+  }
+  uint16_t Asleep  = Permille(p->Sleep, p->Total);
+  uint32_t Msec    = p->Total / HALTIME_PER_MSEC;
+  uint32_t PerSec  = Msec ? p->Wakes * 1000 / Msec : p->Wakes;
+  uint32_t Current = ((uint32_t) (1000 - Asleep) * STATS_ACTIVE_UA + (uint32_t) Asleep * STATS_IDLE_UA) / 1000;
+  snprintf(Line, UIOUT_LINELEN, "%-4s sleep, %lu wakes/sec, asleep %u.%u%%, est %lu uA", WakeName[Class],
+           (unsigned long) PerSec, Asleep / 10, Asleep % 10, (unsigned long) Current);
+}
+
+void StatsGet(uint8_t Id, sStats_t &S) {
+  noInterrupts();
+  S = Stats[Id];
+  interrupts();
+}
+
+// Line Index of the printout, per record a summary then its non empty bins
+// Each call takes its own snapshot, a record the ISR may be updating is copied
+// with interrupts off
+bool StatsLine(uint8_t Index, char *Line) {
+  for (uint8_t Id = 0; Id < STAT_COUNT; Id++) {
+    sStats_t S;
+    StatsGet(Id, S);
+    if (Index == 0) {
+      uint16_t Mean = S.Count ? (uint16_t) (S.Sum / S.Count) : 0;
+      snprintf(Line, UIOUT_LINELEN, "%-4s n %lu, min %u, mean %u, max %u usec", StatName[Id],
+               (unsigned long) S.Count, S.Min, Mean, S.Max);
+      return true;
+    }
+    Index--;
+    for (uint8_t Bin = 0; Bin < STATBINS; Bin++) {
+      if (S.Bin[Bin] == 0) {
+        continue;
+      }
+      if (Index == 0) {
+        uint16_t Low = (Bin == 0) ? 0 : (1U << Bin);
+        if (Bin == STATBINS - 1) {
+          snprintf(Line, UIOUT_LINELEN, "  %5u usec and up  %u", Low, S.Bin[Bin]);
+        } else {
+          snprintf(Line, UIOUT_LINELEN, "  %5u to %5u usec %u", Low, (2U << Bin) - 1, S.Bin[Bin]);
+        }
+        return true;
+      }
+      Index--;
+    }
+  }
+  if (Index < WAKE_COUNT) {
+    WakeLine(Index, Line);
+    return true;
+  }
+  return false;
+}
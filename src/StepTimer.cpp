@@ -0,0 +1,64 @@
+// Step deadline timer
+// TCB0 in periodic interrupt mode counts 0 to CCMP, then restarts and interrupts
+// CNT restarts in hardware at each compare, so long deadlines split into
+// several compare periods add up with no drift from interrupt latency
+// On the last period the timer stops and calls StepDeadlineISR()
+// No interrupts while no deadline is pending
+
+#include "StepTimer.h"
+#include "SequencerStateMachine.h"
+
+static volatile uint32_t StepTicksLeft;     // ticks after the current compare period
+static volatile bool     StepDone = true;   // armed deadline reached
+
+// Next compare period
+// Every period after the first is long, so the ISR rewrites CCMP well before CNT reaches it
+static uint16_t StepChunk(uint32_t Ticks) {
+  if (Ticks <= 0xFFFF) {
+    return (uint16_t) Ticks;
+  }
+  if (Ticks <= 2 * (uint32_t) STEPCHUNK) {
+    return (uint16_t) (Ticks / 2);  // split, both halves over 32768
+  }
+  return STEPCHUNK;
+}
+
+void StepTimerInit() {
+  TCB0.CTRLA    = 0;                    // stopped
+  TCB0.CTRLB    = TCB_CNTMODE_INT_gc;   // periodic interrupt
+  TCB0.INTFLAGS = TCB_CAPT_bm;
+  TCB0.INTCTRL  = TCB_CAPT_bm;
+}
+
+// Called from the state machine on entry to each timed state
+void StepTimerArm(uint32_t Ticks) {
+  TCB0.CTRLA    = 0;                    // stop, cancel any pending deadline
+  TCB0.INTFLAGS = TCB_CAPT_bm;
+  if (Ticks == 0) {
+    StepDone = true;
+    return;
+  }
+  StepDone = false;
+  uint16_t Chunk = StepChunk(Ticks);
+  StepTicksLeft  = Ticks - Chunk;
+  TCB0.CNT       = 0;
+  TCB0.CCMP      = Chunk - 1;           // counts 0 to CCMP
+  TCB0.CTRLA     = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+bool StepTimerDone() {
+  return StepDone;
+}
+
+ISR(TCB0_INT_vect) {
+  TCB0.INTFLAGS = TCB_CAPT_bm;
+  if (StepTicksLeft) {                  // more compare periods to go
+    uint16_t Chunk = StepChunk(StepTicksLeft);
+    StepTicksLeft -= Chunk;
+    TCB0.CCMP      = Chunk - 1;
+    return;
+  }
+  TCB0.CTRLA = 0;
+  StepDone   = true;
+  StepDeadlineISR();                    // may arm the next step
+}
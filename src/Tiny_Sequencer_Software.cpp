@@ -9,7 +9,8 @@
 //   state Tx, transmit ready, assert CTS
 //   
 // on key released, transition thru states to Rx, assuming key remains released
-//   State S4R, release relay 4, release CTS, wait relay 4 release time
+//   state Tx, release CTS, wait CTS lag time
+//   State S4R, release relay 4, wait relay 4 release time
 //   State S3R, release relay 3, wait relay 3 release time
 //   State S2R, release relay 2, wait relay 2 release time
 //   State S1R, release relay 1, wait relay 1 release time 
@@ -47,11 +48,15 @@
 //   Assert a key gate, triggers transition to Rx
 //   Rx waits for Key and RTS signals to release, clears key gate
 
+#include "Hal.h"
 #include "HardwareConfig.h"
 #include "SoftwareConfig.h"
 #include "Config.h"
 #include "SequencerStateMachine.h"
+#include "StepTimer.h"
+#include "Stats.h"
 #include "UserInterface.h"
+#include "HostLink.h"
 #include "Global.h"
 
 #include <stdlib.h>
@@ -59,53 +64,6 @@
 #include <EEPROM.h>
 
 sConfig_t GlobalConf;
-char Msg[80];
-
-#ifdef DEBUG
-// define the global variables
-unsigned long ISR_Time;
-unsigned long Min_ISR_Time;
-unsigned long Max_ISR_Time;
-#endif
-
-//  Setup ATtiny_TimerInterrupt library
-#if !( defined(MEGATINYCORE) )
-  #error The interrupt is designed only for MEGATINYCORE megaAVR board! Please check your Tools->Board setting
-#endif
-// These define's must be placed at the beginning before #include "megaAVR_TimerInterrupt.h"
-// _TIMERINTERRUPT_LOGLEVEL_ from 0 to 4
-// Don't define _TIMERINTERRUPT_LOGLEVEL_ > 0. Only for special ISR debugging only. Can hang the system.
-#define TIMER_INTERRUPT_DEBUG         0
-#define _TIMERINTERRUPT_LOGLEVEL_     0
-
-// Select USING_FULL_CLOCK      == true for  20/16MHz to Timer TCBx => shorter timer, but better accuracy
-// Select USING_HALF_CLOCK      == true for  10/ 8MHz to Timer TCBx => shorter timer, but better accuracy
-// Select USING_250KHZ          == true for 250KHz to Timer TCBx => longer timer,  but worse  accuracy
-// Not select for default 250KHz to Timer TCBx => longer timer,  but worse accuracy
-#define USING_FULL_CLOCK      true
-#define USING_HALF_CLOCK      false
-#define USING_250KHZ          false         // Not supported now
-
-// Try to use RTC, TCA0 or TCD0 for millis()
-#define USE_TIMER_0           true          // Check if used by millis(), Servo or tone()
-#define USE_TIMER_1           false         // Check if used by millis(), Servo or tone()
-
-#if USE_TIMER_0
-  #define CurrentTimer   ITimer0
-#elif USE_TIMER_1
-  #define CurrentTimer   ITimer1
-#else
-  #error You must select one Timer  
-#endif
-
-// To be included only in main(), .ino with setup() to avoid `Multiple Definitions` Linker Error
-#include "ATtiny_TimerInterrupt.h"
-
-#define TIMER1_INTERVAL_MS    10
-#define TIMER1_FREQUENCY      (float) (1000.0f / TIMER1_INTERVAL_MS)
-
-#define ADJUST_FACTOR         ( (float) 0.99850 )
-
 
 #ifdef DEBUG
 void hexDump(byte* data, int length) {
@@ -121,12 +79,12 @@ void hexDump(byte* data, int length) {
 #endif
 
 void setup() {  
+  StackPaint();  // for the stack high water mark
   Serial.begin(57600);
   // Check Configure and init if necessary
   // if Config in EEPROM is invalid, overwrite with InitConfigStructure()
   // if Config is 
-  // Read EEPROM
-  // TODO add function to wear level the eeprom
+  // Read EEPROM, newest record in the wear leveled journal
 
   // Define the pins, configure i/o
   InitPins();
@@ -147,30 +105,46 @@ void setup() {
   digitalWrite(LEDPIN, HIGH);
 
   // EEPROM is preserved through reset and power cycle, but cleared to 0xFF during programming
-  GlobalConf = GetConfig(0);
+  GlobalConf = GetConfig();
   if (!isConfigValid(GlobalConf)) {
     GlobalConf = InitDefaultConfig(); // write default values to Config structure
-    PutConfig(0, GlobalConf);  //save Config structure to EEPROM address 0
+    PrintConfig(GlobalConf);
+    PutConfig(GlobalConf);  //save Config structure to EEPROM journal
   } // if CRC match
-
-  CurrentTimer.init();
-  if (!CurrentTimer.attachInterruptInterval(TIMER1_INTERVAL_MS * ADJUST_FACTOR, SequencerISR)){
-    Serial.println(F("Can't set ITimer. Select another freq. or timer"));
-  } 
+  PublishConfig(GlobalConf);  // sequencer ISR runs on its own copy
+
+  HalCycleInit();   // execution time stats
+  StatsReset();     // sleep accounting starts now, not at power up
+  StepTimerInit();  // one shot step deadlines, before anything can run the state machine
+  HalTimeoutInit();  // Tx timeout watchdog, before any interrupt can arm it
+  HalTickInit(SequencerISR);  // periodic tick, serial key dead-man
+  HalKeyEdgesInit(); // key and RTS edges drive the state machine between ticks
 } // setup()
 
 // this loop is entered seveal seconds after setup()
-// Tx timout is managed at the loop() level, outside of state machine
+// Tx timeout runs on the RTC watchdog, outside of loop(), see HalTimeoutArm()
 void loop() {
   
   digitalWrite(XTRA5PIN, HIGH);
+  HalTime_t PassStart = HalTime();
 
-  // UserConfig update the EEPROM after user input
+  // serial input, host frames answered here, text lines held for UserConfig
+  HostLinkPoll(&GlobalConf);
+  // UserConfig edits GlobalConf after user input
   UserConfig(&GlobalConf);
+  // write edits to EEPROM once the user stops typing
+  CommitConfig(&GlobalConf, false);
 
+  StatsAddLong(STAT_LOOP, PassStart);
   digitalWrite(XTRA5PIN, LOW);
 
+  // sleep out the pass, key bytes and host frames are handled as they arrive
   #define LOOPTIMEINTERVAL 30 // msec
-  delay(LOOPTIMEINTERVAL);
+  while (HalTime() - PassStart < LOOPTIMEINTERVAL * HALTIME_PER_MSEC) {
+    HalTime_t SleepStart = HalTime();
+    HalIdle();
+    StatsIdle(SleepStart);
+    HostLinkPoll(&GlobalConf);
+  }
 }
 
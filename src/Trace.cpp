@@ -0,0 +1,94 @@
+// Sequencer timeline recorder
+// TraceAdd() is a timestamp read and a 6 byte store, cheap enough for every
+// state entry in the ISR, where printing the transition would change its timing
+// The printout holds the ring still, events while it is printed are counted, not kept
+
+#include "Trace.h"
+#include "Hal.h"
+#include "UiOut.h"
+#include "SequencerStateMachine.h"
+
+struct __attribute__((packed)) sTraceRec_t {
+  HalTime_t Time;    // HalTime()
+  uint8_t  Event;
+  uint8_t  Arg;
+};
+
+static sTraceRec_t      Ring[TRACELEN];
+static volatile uint8_t Head;       // next record written
+static volatile uint8_t Count;      // records in the ring, up to TRACELEN
+static volatile bool    Held;
+static volatile uint16_t Missed;    // events while held
+
+void TraceAdd(uint8_t Event, uint8_t Arg) {
+  if (Held) {
+    if (Missed != 0xFFFF) {
+      Missed++;
+    }
+    return;
+  }
+  sTraceRec_t *p = &Ring[Head];
+  p->Time   = HalTime();
+  p->Event  = Event;
+  p->Arg    = Arg;
+  Head = (Head + 1 == TRACELEN) ? 0 : Head + 1;
+  if (Count < TRACELEN) {
+    Count++;
+  }
+}
+
+void TraceHold(bool Hold) {
+  Held = Hold;
+}
+
+void TraceReset() {
+  noInterrupts();
+  Head   = 0;
+  Count  = 0;
+  Missed = 0;
+  interrupts();
+}
+
+// Line Index of the printout, a header then one record per line, oldest first
+// Times are usec after the oldest record, and since the record before
+bool TraceLine(uint8_t Index, char *Line) {
+  if (Index == 0) {
+    snprintf(Line, UIOUT_LINELEN, "Trace, %u events, %u missed while printing", Count, Missed);
+    return true;
+  }
+  Index--;
+  if (Index >= Count) {
+    return false;
+  }
+  uint8_t Oldest = (Head + TRACELEN - Count) % TRACELEN;
+  const sTraceRec_t &Rec   = Ring[(Oldest + Index) % TRACELEN];
+  const sTraceRec_t &First = Ring[Oldest];
+  const sTraceRec_t &Prev  = Ring[(Oldest + Index + TRACELEN - (Index ? 1 : 0)) % TRACELEN];
+  unsigned long At    = HalTimeToUsec(Rec.Time - First.Time);
+  unsigned long Delta = HalTimeToUsec(Rec.Time - Prev.Time);
+  char What[24];
+  switch (Rec.Event) {
+    case TRACE_STATE:
+      StateName(Rec.Arg, What);
+      break;
+    case TRACE_KEY:
+      snprintf(What, sizeof(What), "key%s%s%s%s", Rec.Arg ? "" : " up",
+               (Rec.Arg & TRACEKEY_PIN) ? " pin" : "", (Rec.Arg & TRACEKEY_RTS) ? " RTS" : "",
+               (Rec.Arg & TRACEKEY_SERIAL) ? " serial" : "");
+      break;
+    case TRACE_TIMEOUT:
+      strcpy(What, (Rec.Arg == TRACETO_TX) ? "Tx timeout" : "serial key dead-man");
+      break;
+    case TRACE_GLITCH:
+      strcpy(What, Rec.Arg ? "key dropout rejected" : "key glitch rejected");
+      break;
+    case TRACE_CTS:
+      strcpy(What, Rec.Arg ? "CTS up" : "CTS down");
+      break;
+    default:
+      strcpy(What, "?");
+      break;
+  }
+  snprintf(Line, UIOUT_LINELEN, "%10lu usec  +%9lu  %s", At, Delta, What);
+  return true;
+}
@@ -0,0 +1,83 @@
+// User interface output, drop and pace instead of blocking
+// Serial.write() waits for room in the TX ring, at 57600 baud a few hundred bytes
+// of help or config held loop() for tens of msec per pass
+// Here a write only goes to Serial when the whole write fits
+
+#include "UiOut.h"
+
+#if SERIAL_TX_BUFFER_SIZE < UIOUT_PASSROOM
+#error SERIAL_TX_BUFFER_SIZE too small for UIOUT_PASSROOM, see platformio.ini
+#endif
+
+UiOutClass UiOut;
+
+static void CountDrop(uint16_t &Dropped, size_t Len) {
+  Dropped = ((uint32_t) Dropped + Len > 0xFFFF) ? 0xFFFF : Dropped + Len;
+}
+
+size_t UiOutClass::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+// print() hands each string here in one call, Print::println() the line end in another
+size_t UiOutClass::write(const uint8_t *Buf, size_t Len) {
+  #if UIOUT_NONBLOCKING
+  if ((size_t) Serial.availableForWrite() < Len) {
+    CountDrop(DroppedBytes, Len);
+    return 0;
+  }
+  #endif
+  return Serial.write(Buf, Len);
+}
+
+int UiOutClass::availableForWrite() {
+  return Serial.availableForWrite();
+}
+
+// strings can be longer than a UIOUT_LINELEN line, the prompt, so the room for
+// both is checked first, the ring only gains room until the next write from loop()
+size_t UiOutClass::println(const char *s) {
+  size_t Len = strlen(s);
+  #if UIOUT_NONBLOCKING
+  if ((size_t) Serial.availableForWrite() < Len + 2) {
+    CountDrop(DroppedBytes, Len + 2);
+    return 0;
+  }
+  #endif
+  return write((const uint8_t *) s, Len) + write((const uint8_t *) "\r\n", 2);
+}
+
+// the line and its \r\n are built on the stack, there is no static message buffer
+size_t UiOutClass::PrintLine(const char *Format, ...) {
+  char Text[UIOUT_LINELEN + 2];
+  va_list Args;
+  va_start(Args, Format);
+  int Len = vsnprintf(Text, UIOUT_LINELEN, Format, Args);
+  va_end(Args);
+  if (Len < 0) {
+    Len = 0;
+  } else if (Len > UIOUT_LINELEN - 1) {
+    Len = UIOUT_LINELEN - 1;            // cut like the buffer
+  }
+  Text[Len++] = '\r';
+  Text[Len++] = '\n';
+  return write((const uint8_t *) Text, Len);
+}
+
+uint16_t UiOutClass::Dropped() {
+  return DroppedBytes;
+}
+
+bool UiOutLines(UiLine_t Source, uint8_t &Index) {
+  char Line[UIOUT_LINELEN];
+  while (Source(Index, Line)) {
+    #if UIOUT_NONBLOCKING
+    if ((size_t) UiOut.availableForWrite() < strlen(Line) + 2) {
+      return false;  // no room for the line and its \r\n, next pass
+    }
+    #endif
+    UiOut.println(Line);
+    Index++;
+  }
+  return true;
+}
@@ -4,15 +4,23 @@
 // user enters a line of characters terminated by \r
 // build line character array
 // line contain command and variable number of parameters
+// A new line is parsed whole by ParseLine(), in place, and applied in the same pass
+// Commands are separated by spaces or ';', the line is applied only if all of it is valid
+// A line holding one incomplete command falls back to the token state machine:
 // Extract the command token, first token from line
 // Set next state based on command first character {s, k, r, c, t, d}
 // each command state processes next token or prompts and waits for more serial input
 
 #include "UserInterface.h"
+#include "Hal.h"
 #include "HardwareConfig.h"
 #include "SoftwareConfig.h"
+#include "SequencerStateMachine.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "UiOut.h"
+#include "HostLink.h"
 #include "Global.h"
-#include <SerialReadLine.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <EEPROM.h>
@@ -23,20 +31,29 @@ enum UserConfigState {
   top,            // display top info, go to cmd
    cmd,           // wait for command {s, r, c, t, d i, h}
     stepIdx,      // wait for number {1, 2, 3, 4}
-      stepArg,    // wait for step command {t, r, o, c}
+      stepArg,    // wait for step command {t, r, a, o, c}
         msec,     // wait for msec
     rts,          // wait for {enable, disable}
     cts,          // wait for {enable, disable}
     timeout,      // wait for Time, seconds 0 means disabled
-    display,      // PrintConfig(), go to cmd
+    keyalive,     // wait for msec, 0 means in-band serial key disabled
+    filter,       // wait for key filter assert msec
+     filterRel,   // wait for key filter release msec
+    guard,        // wait for CTS lead msec
+     guardLag,    // wait for CTS lag msec
+    display,      // config and status, paged, go to cmd
     Init,         // InitDefaultConfig(), needs whole token
     Boot ,        // call software reset, need whole token
-    help,         // PrintHelp()
+    Save,         // CommitConfig() now, needs whole token
+    stats,        // StatsLine() paged, or StatsReset() on 'reset'
+    trace,        // TraceLine() paged, or TraceReset() on 'reset'
+    help,         // HelpText paged
     err           // user input not understood, go to top
 };
 
 // convienent char arrays for debug messages
-const char *userStateName[][15] = {"top", 
+// const pointers to const text, table and strings stay in flash
+const char * const userStateName[] = {"top", 
                                      "cmd", 
                                        "stepIdx", 
                                          "stepArg", 
@@ -44,9 +61,17 @@ const char *userStateName[][15] = {"top",
                                        "rts", 
                                        "cts", 
                                        "timeout", 
+                                       "keyalive", 
+                                       "filter", 
+                                        "filterRel", 
+                                       "guard", 
+                                        "guardLag", 
                                        "display", 
                                        "Init", 
                                        "Boot",
+                                       "Save",
+                                       "stats",
+                                       "trace",
                                        "help", 
                                        "err"};
 
@@ -55,97 +80,187 @@ static UserConfigState prevUCS = err;
 static UserConfigState UCS = err;
 static UserConfigState nextUCS = top;
 
+// UI working copy of the config, edited in place
+// published to *pConfig only on a pass that edits it
+static sConfig_t WorkConf;
+
 #define LINELEN 40
 char Line[LINELEN + 1];   // Line of user text needs to be available to multiple functions
+static uint8_t PageLine;  // next line of a paged printout, help, display, stats
+static bool    StatsResetReq; // 'stats reset', set with the stats command
+static bool    TraceResetReq; // 'trace reset', set with the trace command
+
+#define CMDPROMPT "Command list: Step, RTS, CTS, Timeout, Keyalive, Filter, Guard, Display, Init, Boot, Save, Stats, Trace, Help"
+
+// Help text, paged out by UiOutLines(), %d is the last step number
+static const char * const HelpText[] = {
+  "This is help for the user interface.",
+  "The user enters command and parameters, MCU echos after end of line",
+  "Input can be one token at a time or all the tokens for a command",
+  "Several commands to a line, separated by ';', all checked before any apply",
+  "Top level: 'S'tep, 'R'TS, 'C'TS, 'T'imeout, 'D'isplay, 'P'rom,",
+  "           'I'nitialize, 'Save', 'Stats', 'H'elp",
+  "Step {number 0 to %d} {'T'x, 'R'x delay, 'A'fter, 'O'pen, 'C'losed on rx}",
+  "RTS {'E'nable, 'D'isable}",
+  "CTS {'E'nable, 'D'isable}",
+  "Timeout 0 to 255 seconds, Tx timeout, 0 means disable",
+  "Keyalive 0 to 10000 msec, in-band serial key dead-man, 0 means disable",
+  "Filter {assert msec} {release msec} 0 to 50, Key held that long, 0 is at once",
+  "Guard {lead msec} {lag msec} 0 to 255, CTS up after Tx, relays wait after CTS",
+  "Display, print working configuration, key latency and stack use",
+  "'Init', spelled out, initialize configuration to programmed defaults",
+  "Help, print this text",
+  "Changes are written to EEPROM 2 sec after the last edit",
+  "'Save' command, spelled out, writes changes to EEPROM now",
+  "'Boot' command, spelled out, simulates power cycle",
+  "'Stats' command, spelled out, ISR and loop times, 'Stats reset' clears them",
+  "'Trace' command, spelled out, last state changes, key edges, timeouts, usec",
+  "Examples...",
+  "   's 0 t 100' step 0 tx delay 100 msec",
+  "   's 1 r 0.3' step 1 rx delay 0.3 msec, steps 0 to 6553.5 msec",
+  "   'step 0 tx 100' step 0 tx delay 100 msec, long form",
+  "   's 3 o, step 3 Open on Rx",
+  "   's 2 a 0' step 2 starts and releases with step 1, 's 2 a 5' 5 msec after",
+  "   's 2 a s' step 2 after step 1 is done, default, first and last always",
+  "   's 0 t 100; s 0 r 50; r e', three commands, applied together",
+  "   'r e', RTS enable",
+  "   't 120', tx timeout 120 seconds",
+  "   't 1', tx timeout disabled",
+  "   'k 500', in-band key drops 500 msec after the last key byte",
+  "   'f 2 10', Key input asserts after 2 msec, releases after 10 msec",
+  "   'g 5 10', CTS up 5 msec after Tx, relays release 10 msec after CTS drops",
+  "   'd', display configuration",
+  "   'Init', initialize to programmed defaults, needs whole command",
+  "   'Boot', reboot using software reset, needs whole command",
+  "   'Save', write changes to EEPROM now, needs whole command",
+  "   'stats', ISR and loop min, mean, max and histogram in usec",
+  "   'stats reset', clear the stats",
+  "   'trace', relay step timeline, 'trace reset' clears it"
+};
+#define HELPLINES (sizeof(HelpText) / sizeof(HelpText[0]))
+
+static bool HelpLine(uint8_t Index, char *Text) {
+  if (Index >= HELPLINES) {
+    return false;
+  }
+  snprintf(Text, UIOUT_LINELEN, HelpText[Index], NSTEPS - 1);
+  return true;
+}
+
+// Display, the working config then status lines
+static bool DisplayLine(uint8_t Index, char *Text) {
+  if (Index < CONFIGLINES) {
+    return ConfigLine(WorkConf, Index, Text);
+  }
+  switch (Index - CONFIGLINES) {
+    case 0:
+      strcpy(Text, ConfigDirtyFields() ? "Changes not yet written to EEPROM" : "EEPROM up to date");
+      break;
+    case 1:
+      snprintf(Text, UIOUT_LINELEN, "Key to output latency %u usec, max %u usec", KeyLatency(), MaxKeyLatency());
+      break;
+    case 2:
+      snprintf(Text, UIOUT_LINELEN, "Stack never used %u bytes", StackUnused());
+      break;
+    case 3:
+      snprintf(Text, UIOUT_LINELEN, "Serial output dropped %u bytes", UiOut.Dropped());
+      break;
+    case 4:
+      snprintf(Text, UIOUT_LINELEN, "Serial key dead-man drops %u", SerialKeyExpiries());
+      break;
+    case 5:
+      snprintf(Text, UIOUT_LINELEN, "Key glitches rejected %u", KeyGlitches());
+      break;
+    case 6: {
+      uint16_t Left = TxTimeoutLeft();
+      if (Left) {
+        snprintf(Text, UIOUT_LINELEN, "Tx timeout in %u.%u sec, %u timeouts", Left / 10, Left % 10, TxTimeouts());
+      } else {
+        snprintf(Text, UIOUT_LINELEN, "Tx timeout not running, %u timeouts", TxTimeouts());
+      }
+      break;
+    }
+    case 7:
+      snprintf(Text, UIOUT_LINELEN, "Key release to CTS down %u usec, max %u usec", CTSLatency(), MaxCTSLatency());
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
 
-void PrintHelp() {
-  Serial.println("This is help for the user interface.");
-  Serial.println("The user enters command and parameters, MCU echos after end of line");
-  Serial.println("Input can be one token at a time or all the tokens for a command");
-  Serial.println("Top level: 'S'tep, 'R'TS, 'C'TS, 'T'imeout, 'D'isplay, 'P'rom, 'I'nitialize, 'H'elp");
-  Serial.println("Step {Step number 0 to 3} {'T'x delay, 'R'x delay, 'O'pen on rx, 'C'losed on rx}");
-  Serial.println("RTS {'E'nable, 'D'isable}");
-  Serial.println("CTS {'E'nable, 'D'isable}");
-  Serial.println("Timeout 0 to 255 seconds, Tx timeout, 0 means disable");
-  Serial.println("Display, print working configuration");
-  Serial.println("'Init', spelled out, initialize configuration to programmed defaults");
-  Serial.println("Help, print this text");
-  Serial.println("Changes are automatically written to EEPROM");
-  Serial.println("'Boot' command, spelled out, simulates power cycle");
-  Serial.println("Examples...");
-  Serial.println("   's 0 t 100' step 0 tx delay 100 msec");
-  Serial.println("   'step 0 tx 100' step 0 tx delay 100 msec, long form");
-  Serial.println("   's 3 o, step 3 Open on Rx");
-  Serial.println("   'r e', RTS enable");
-  Serial.println("   't 120', tx timeout 120 seconds");
-  Serial.println("   't 1', tx timeout disabled");
-  Serial.println("   'd', display configuration");
-  Serial.println("   'Init', initialize to programmed defaults, needs whole command");
-  Serial.println("   'Boot', reboot using software reset, needs whole command");
+static bool TopLine(uint8_t Index, char *Text) {
+  return ConfigLine(WorkConf, Index, Text);
 }
 
 // Called after each case statement for user state machine
 // token exists in strtok() buffer, return point to it
 // if strtok() retuns NULL, and first pass emit prompt, 
-//    wait for line from serial-readline
+//    wait for line from HostLinkReadLine()
 // cases
 //  first pass, token null:  prompt, return null
 //  first pass, token valid: return Token
 //  nth pass, token null:    return null
 //  nth pass, Token valid:   return Token
+// No pending tokens, the next strtok(NULL) returns NULL
+// strtok(NULL) before any line was tokenized is not portable
+static void ClearTokens() {
+  Line[0] = '\0';
+  strtok(Line, " ");
+}
+
+// Line from HostLinkReadLine() into Line[], true when a new line is there
+static bool ReadLine() {
+  uint8_t LineLen = HostLinkReadLine(Line, sizeof(Line));
+  if (LineLen == 0) {
+    return false;
+  }
+  if (LineLen > LINELEN) { 
+    UiOut.println("GetNextToken: error, user input too long for Line[40]");
+    return false;
+  }
+  UiOut.PrintLine("User entered '%s', %d char", Line, LineLen);
+  return true;
+}
+
 char * GetNextToken(const char * Prompt) {
   char * Token;
   if (prevUCS != UCS) {         // on first pass, try to get next token on current line
     Token = strtok(NULL, " ");  // returns a pointer to internal char array
     if (Token == NULL) {
-      Serial.println(Prompt);   // Prompt on first pass
+      UiOut.println(Prompt);   // Prompt on first pass
       return NULL;
     }
     // first pass, Token not nulls
     return Token;
   }
   // after first pass
-  reader.poll(); // Since no token, wait for line
-  if (!reader.available()) {
+  if (!ReadLine()) {  // Since no token, wait for line
     return NULL;
   }
 
-  uint8_t LineLen = reader.len();
-  if (LineLen > LINELEN) { 
-    char LineFlush[reader.len()];
-    reader.read(LineFlush);
-    Serial.println("GetNextToken: error, user input too long for Line[40]");
-    return NULL;
-  }
-
-  reader.read(Line);  // copy into local buffer
-  snprintf(Msg, 80, "User entered '%s', %d char", Line, LineLen);
-  Serial.println(Msg);
-
   Token = strtok(Line, " ");  // update strtok buffer with new line
   // Line available, may have a token
-  //snprintf(Msg, 80, "GetNextToken: token from Line len -%d- -%s-", strlen(Token), Token);
-  //Serial.println(Msg);
+  //UiOut.PrintLine("GetNextToken: token from Line len -%d- -%s-", strlen(Token), Token);
   return Token;  
 } // GetNextToken
 
-// get the step index from 0 to 3
-// returns 0 to 3 or -1 if error
+// get the step index from 0 to NSTEPS - 1
+// returns 0 to NSTEPS - 1 or -1 if error
 int8_t GetStepIdx(char * Token) {
   char * endptr;
   long lStepIdx = strtol(Token, &endptr, 10);
 
   if (errno == ERANGE) {
-    Serial.println("GetStepIdx: strtol() ERANGE");
+    UiOut.println("GetStepIdx: strtol() ERANGE");
     return -1;
   } else if (endptr == Token) {
-    Serial.println("GetStepIdx: (endptr == Token), no conversion");
+    UiOut.println("GetStepIdx: (endptr == Token), no conversion");
     return -1;
   } else if (*endptr != '\0') {
-    snprintf(Msg, 80, "GetStepIdx: Token %x, '%s', endptr %x, '%s', ", Token, endptr, endptr);
-    Serial.println(Msg);
+    UiOut.PrintLine("GetStepIdx: Token '%s', not a number at '%s'", Token, endptr);
     return -1;
-  } else if ((lStepIdx < 0) | (lStepIdx > 3)) {
+  } else if ((lStepIdx < 0) | (lStepIdx >= NSTEPS)) {
     return -1;
   } else {
     return static_cast <int8_t> (lStepIdx);
@@ -155,16 +270,342 @@ int8_t GetStepIdx(char * Token) {
 #define OPEN   LOW    // map Digital pin to Sequencer contact closure 
 #define CLOSED HIGH
 
+// ******** single pass line parser ********
+// Tokens are a pointer and length into Line, the line is not copied or written,
+// so it is still intact for strtok() if the parse falls back
+// Each command is applied to a staged copy of the config, the copy replaces
+// the working config only when the whole line is valid
+// An action, Display, Help, Init, Boot, Save or Stats, may only end the line
+struct sTok_t {
+  const char *p;
+  uint8_t     n;
+};
+
+enum ParseResult {
+  PARSE_DONE,        // whole line valid and applied
+  PARSE_INCOMPLETE,  // one command, arguments missing, prompt for them
+  PARSE_ERROR        // message printed, nothing applied
+};
+
+// next token of the current command, false at ';' or end of line
+static bool NextTok(const char *&p, sTok_t &Tok) {
+  while (*p == ' ') {
+    p++;
+  }
+  if ((*p == '\0') || (*p == ';')) {
+    return false;
+  }
+  Tok.p = p;
+  while ((*p != '\0') && (*p != ' ') && (*p != ';')) {
+    p++;
+  }
+  Tok.n = (uint8_t) (p - Tok.p);
+  return true;
+}
+
+// whole token match, Exact for the spelled out commands
+static bool TokIs(const sTok_t &Tok, const char *Word, bool Exact) {
+  if (strlen(Word) != Tok.n) {
+    return false;
+  }
+  return Exact ? (strncmp(Tok.p, Word, Tok.n) == 0) : (strncasecmp(Tok.p, Word, Tok.n) == 0);
+}
+
+// decimal digits only, 0 to Max
+static bool TokNum(const sTok_t &Tok, uint16_t Max, uint16_t &Value) {
+  uint32_t Num = 0;
+  if (Tok.n > 5) {
+    return false;
+  }
+  for (uint8_t i = 0; i < Tok.n; i++) {
+    if (!isdigit(Tok.p[i])) {
+      return false;
+    }
+    Num = Num * 10 + (Tok.p[i] - '0');
+  }
+  if (Num > Max) {
+    return false;
+  }
+  Value = (uint16_t) Num;
+  return true;
+}
+
+// msec with at most one decimal, "75", "0.3", "6553.5", to 100 usec units, 0 to Max
+static bool TokTenths(const sTok_t &Tok, uint16_t Max, uint16_t &Value) {
+  uint32_t Num = 0;
+  uint8_t  i;
+  if (Tok.n > 7) {
+    return false;
+  }
+  for (i = 0; (i < Tok.n) && isdigit(Tok.p[i]); i++) {
+    Num = Num * 10 + (Tok.p[i] - '0');
+  }
+  if (i == 0) {
+    return false;
+  }
+  Num *= STEPUNITS_PER_MSEC;
+  if (i < Tok.n) {
+    if ((Tok.n - i != 2) || (Tok.p[i] != '.') || !isdigit(Tok.p[i + 1])) {
+      return false;
+    }
+    Num += Tok.p[i + 1] - '0';
+  }
+  if (Num > Max) {
+    return false;
+  }
+  Value = (uint16_t) Num;
+  return true;
+}
+
+static ParseResult ParseError(const char *What, const sTok_t &Tok) {
+  UiOut.PrintLine("Parse: %s '%.*s', nothing applied", What, Tok.n, Tok.p);
+  return PARSE_ERROR;
+}
+
+// One command from p, advances p past it
+// Edits go to Stage and StageEdited, an action to Action
+static ParseResult ParseCommand(const char *&p, sConfig_t &Stage, uint16_t &StageEdited,
+                                UserConfigState &Action) {
+  sTok_t Cmd, Arg;
+  uint16_t Value;
+  NextTok(p, Cmd);                               // caller checked there is one
+  switch (tolower(Cmd.p[0])) {
+    case 's':
+      if (TokIs(Cmd, "Save", true)) {
+        Action = Save;
+        return PARSE_DONE;
+      }
+      if (TokIs(Cmd, "stats", false)) {
+        const char *Peek = p;
+        StatsResetReq = NextTok(Peek, Arg) && TokIs(Arg, "reset", false);
+        if (StatsResetReq) {
+          p = Peek;
+        }
+        Action = stats;
+        return PARSE_DONE;
+      }
+      {
+        if (!NextTok(p, Arg)) {
+          return PARSE_INCOMPLETE;
+        }
+        uint16_t Idx;
+        if (!TokNum(Arg, NSTEPS - 1, Idx)) {
+          return ParseError("invalid step number", Arg);
+        }
+        if (!NextTok(p, Arg)) {
+          return PARSE_INCOMPLETE;
+        }
+        switch (tolower(Arg.p[0])) {
+          case 'o':
+            Stage.Step[Idx].RxPolarity = OPEN;
+            break;
+          case 'c':
+            Stage.Step[Idx].RxPolarity = CLOSED;
+            break;
+          case 't':
+          case 'r': {
+            sTok_t Msec;
+            if (!NextTok(p, Msec)) {
+              return PARSE_INCOMPLETE;
+            }
+            if (!TokTenths(Msec, STEPUNITS_MAX, Value)) {
+              return ParseError("msec 0 to 6553.5, not", Msec);
+            }
+            if (tolower(Arg.p[0]) == 't') {
+              Stage.Step[Idx].Tx_100us = Value;
+            } else {
+              Stage.Step[Idx].Rx_100us = Value;
+            }
+            break;
+          }
+          case 'a': {
+            sTok_t Msec;
+            if (!NextTok(p, Msec)) {
+              return PARSE_INCOMPLETE;
+            }
+            if ((Idx == 0) || (Idx == NSTEPS - 1)) {
+              UiOut.PrintLine("Parse: step %u is serial, 'After' is for steps 1 to %u, nothing applied",
+                              Idx, NSTEPS - 2);
+              return PARSE_ERROR;
+            }
+            if (TokIs(Msec, "s", false) || TokIs(Msec, "serial", false)) {
+              Value = STEPSERIAL;
+            } else if (!TokTenths(Msec, STEPSERIAL - 1, Value)) {
+              return ParseError("after msec 0 to 6553.4 or Serial, not", Msec);
+            }
+            Stage.Step[Idx].Start_100us = Value;
+            break;
+          }
+          default:
+            return ParseError("step {Tx, Rx, After, Open, Closed}, not", Arg);
+        }
+        StageEdited |= (CONF_STEP0 << Idx);
+        return PARSE_DONE;
+      }
+    case 'r':
+    case 'c':
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if ((tolower(Arg.p[0]) != 'e') && (tolower(Arg.p[0]) != 'd')) {
+        return ParseError("{Enable, Disable}, not", Arg);
+      }
+      if (tolower(Cmd.p[0]) == 'r') {
+        Stage.RTSEnable = (tolower(Arg.p[0]) == 'e');
+        StageEdited |= CONF_RTS;
+      } else {
+        Stage.CTSEnable = (tolower(Arg.p[0]) == 'e');
+        StageEdited |= CONF_CTS;
+      }
+      return PARSE_DONE;
+    case 't':
+      if (TokIs(Cmd, "trace", false)) {
+        const char *Peek = p;
+        TraceResetReq = NextTok(Peek, Arg) && TokIs(Arg, "reset", false);
+        if (TraceResetReq) {
+          p = Peek;
+        }
+        Action = trace;
+        return PARSE_DONE;
+      }
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, TIMEOUTMAX, Value)) {
+        return ParseError("timeout seconds 0 to 255, not", Arg);
+      }
+      Stage.Timeout = Value;
+      StageEdited |= CONF_TIMEOUT;
+      return PARSE_DONE;
+    case 'k':
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, KEYALIVEMAX, Value)) {
+        return ParseError("keyalive msec 0 to 10000, not", Arg);
+      }
+      Stage.KeyAlive = Value;
+      StageEdited |= CONF_KEYALIVE;
+      return PARSE_DONE;
+    case 'f':
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, KEYFILTERMAX, Value)) {
+        return ParseError("filter assert msec 0 to 50, not", Arg);
+      }
+      Stage.KeyAssert = (uint8_t) Value;
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, KEYFILTERMAX, Value)) {
+        return ParseError("filter release msec 0 to 50, not", Arg);
+      }
+      Stage.KeyRelease = (uint8_t) Value;
+      StageEdited |= CONF_KEYFILTER;
+      return PARSE_DONE;
+    case 'g':
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, CTSGUARDMAX, Value)) {
+        return ParseError("guard lead msec 0 to 255, not", Arg);
+      }
+      Stage.CTSLead = (uint8_t) Value;
+      if (!NextTok(p, Arg)) {
+        return PARSE_INCOMPLETE;
+      }
+      if (!TokNum(Arg, CTSGUARDMAX, Value)) {
+        return ParseError("guard lag msec 0 to 255, not", Arg);
+      }
+      Stage.CTSLag = (uint8_t) Value;
+      StageEdited |= CONF_CTS;
+      return PARSE_DONE;
+    case 'd':
+      Action = display;
+      return PARSE_DONE;
+    case 'h':
+      Action = help;
+      return PARSE_DONE;
+    case 'i':
+      if (!TokIs(Cmd, "Init", true)) {
+        return ParseError("spell out 'Init', not", Cmd);
+      }
+      Action = Init;
+      return PARSE_DONE;
+    case 'b':
+      if (!TokIs(Cmd, "Boot", true)) {
+        return ParseError("spell out 'Boot', not", Cmd);
+      }
+      Action = Boot;
+      return PARSE_DONE;
+    default:
+      return ParseError("invalid command", Cmd);
+  }
+}
+
+// Parse and apply a whole line, Action is the state to run after it, cmd if none
+static ParseResult ParseLine(const char *p, sConfig_t &Config, uint16_t &Edited,
+                             UserConfigState &Action) {
+  sConfig_t Stage       = Config;
+  uint16_t  StageEdited = 0;
+  uint8_t   Commands    = 0;
+  Action = cmd;
+  for (;;) {
+    while ((*p == ' ') || (*p == ';')) {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    if (Action != cmd) {
+      UiOut.PrintLine("Parse: '%s' must end the line, nothing applied", userStateName[Action]);
+      return PARSE_ERROR;
+    }
+    ParseResult Result = ParseCommand(p, Stage, StageEdited, Action);
+    Commands++;
+    if (Result == PARSE_INCOMPLETE) {
+      while (*p == ' ') {
+        p++;
+      }
+      if ((Commands == 1) && (*p == '\0')) {
+        return PARSE_INCOMPLETE;
+      }
+      UiOut.println("Parse: incomplete command, nothing applied");
+      return PARSE_ERROR;
+    }
+    if (Result == PARSE_ERROR) {
+      return PARSE_ERROR;
+    }
+  }
+  Config  = Stage;
+  Edited |= StageEdited;
+  return PARSE_DONE;
+}
+
+void UserConfigSync(const sConfig_t &Config) {
+  WorkConf = Config;
+}
+
 void UserConfig(sConfig_t *pConfig) {
-  sConfig_t Config = *pConfig;  // Make a local copy of the config
+  sConfig_t &Config = WorkConf;  // edit the working copy, no per pass copy
   static char * Token;
   char * endptr;
-  long lmsec;
+  uint16_t Units;  // step time, 100 usec
 
   // these variable get passed from state call to state call
-  static uint8_t StepIdx;  // step command index number, {0 to 3}
+  static uint8_t StepIdx;  // step command index number, {0 to NSTEPS - 1}
   static char    StepArg;  // step command argument {Tx, Rx, Open, Closed}
   static char    CmdChar;  // used for token processing
+  static uint8_t FilterAssert; // filter command, assert msec until release msec arrives
+  static uint8_t GuardLead;    // guard command, lead msec until lag msec arrives
+  uint16_t       Edited = 0; // CONF_ bits changed on this pass
+
+  #if UIOUT_NONBLOCKING
+  if (UiOut.availableForWrite() < UIOUT_PASSROOM) {
+    return;  // TX ring still draining, input waits in the RX ring
+  }
+  #endif
 
   prevUCS = UCS;
   UCS = nextUCS;  
@@ -172,19 +613,53 @@ void UserConfig(sConfig_t *pConfig) {
   switch (UCS) {
 
   case top: // nextUCS initialized to top, then shifted to UCS
-    Serial.println("UserIntf: switch(UCS) top");
-    PrintConfig(Config);
-    nextUCS = cmd;
+    if (prevUCS != UCS) {
+      UiOut.println("UserIntf: switch(UCS) top");
+      WorkConf = *pConfig;  // start editing from the published config
+      ClearTokens();
+      PageLine = 0;
+    }
+    if (UiOutLines(TopLine, PageLine)) {
+      nextUCS = cmd;
+    }
     break;
 
   case cmd: // wait for user command, next state based on first letter
-    Token = GetNextToken("Command list: Step, RTS, CTS, Timeout, Display, Init, Boot, Help");
+    if (prevUCS != UCS) {   // first pass, rest of a line from the token states
+      Token = GetNextToken(CMDPROMPT);
+    } else {                // new line, parse and apply it whole
+      if (!ReadLine()) {
+        break;
+      }
+      UserConfigState Action;
+      ParseResult Result = ParseLine(Line, Config, Edited, Action);
+      if (Result != PARSE_INCOMPLETE) {
+        ClearTokens();      // line used up, nothing left for strtok(NULL)
+        if ((Result == PARSE_DONE) && (Action != cmd)) {
+          nextUCS = Action;
+        } else {
+          UiOut.println(CMDPROMPT);
+        }
+        break;
+      }
+      Token = strtok(Line, " ");  // fall back, prompt for the missing arguments
+    }
     if (Token == NULL) {
       break;
     }
     CmdChar = (char) tolower(Token[0]);
     switch (CmdChar) { // switch on first character of first token
       case 's':
+        if (strcmp(Token, "Save") == 0) { // whole token, else step command
+          nextUCS = Save;
+          break;
+        }
+        if (strcasecmp(Token, "stats") == 0) { // whole token, else step command
+          Token = strtok(NULL, " ");
+          StatsResetReq = (Token != NULL) && (strcasecmp(Token, "reset") == 0);
+          nextUCS = stats;
+          break;
+        }
         nextUCS = stepIdx; // wait for number {1, 2, 3, 4}
         break;
       case 'r':
@@ -194,22 +669,45 @@ void UserConfig(sConfig_t *pConfig) {
         nextUCS = cts;     // wait for {enable, disable}
         break;
       case 't':
+        if (strcasecmp(Token, "trace") == 0) { // whole token, else timeout command
+          Token = strtok(NULL, " ");
+          TraceResetReq = (Token != NULL) && (strcasecmp(Token, "reset") == 0);
+          nextUCS = trace;
+          break;
+        }
         nextUCS = timeout; // wait for seconds
         break;
+      case 'k':
+        nextUCS = keyalive; // wait for msec
+        break;
+      case 'f':
+        nextUCS = filter;   // wait for assert msec, then release msec
+        break;
+      case 'g':
+        nextUCS = guard;    // wait for lead msec, then lag msec
+        break;
       case 'd': 
         nextUCS = display;
         break;
       case 'i':            // reinitialize config
-        nextUCS = Init;    // require whole token
+        if (strcmp(Token, "Init") == 0) { // require whole token
+          nextUCS = Init;
+          break;
+        }
+        UiOut.PrintLine("UserInterface: 'Init' command entry error -%s-", Token);
         break;
       case 'b':            // reboot as if from power cycle
-        nextUCS = Boot;    // require whole token
+        if (strcmp(Token, "Boot") == 0) { // require whole token
+          nextUCS = Boot;
+          break;
+        }
+        UiOut.PrintLine("UserInterface: 'Boot' command entry error -%s-", Token);
         break;
       case 'h': 
         nextUCS = help;
         break;
       default:
-        Serial.println("UserInterface: switch(cmd) default, invalid command");
+        UiOut.println("UserInterface: switch(cmd) default, invalid command");
         nextUCS = top;
     } // switch (CmdChar)
     break; // switch(UCS) case cmd:
@@ -221,17 +719,19 @@ void UserConfig(sConfig_t *pConfig) {
     } 
     switch (tolower(Token[0])) {
     case 'e':
-      //Serial.println("RTS enabled");
+      //UiOut.println("RTS enabled");
       Config.RTSEnable = true;
+      Edited |= CONF_RTS;
       nextUCS = cmd;
       break;
     case 'd':
-      //Serial.println("RTS Disabled");
+      //UiOut.println("RTS Disabled");
       Config.RTSEnable = false;
+      Edited |= CONF_RTS;
       nextUCS = cmd;
       break;
     default:
-      Serial.println("UserInterface: rts {Enable, Disable} not found");
+      UiOut.println("UserInterface: rts {Enable, Disable} not found");
     } // switch(tolower(Token[0]))
     break; // case rts:
     
@@ -242,80 +742,182 @@ void UserConfig(sConfig_t *pConfig) {
     }
     switch (tolower(Token[0])) {
     case 'e':
-      Serial.println("CTS enabled");
+      UiOut.println("CTS enabled");
       Config.CTSEnable = true;
+      Edited |= CONF_CTS;
       nextUCS = cmd;
       break;
     case 'd':
-      Serial.println("CTS Disabled");
+      UiOut.println("CTS Disabled");
       Config.CTSEnable = false;
+      Edited |= CONF_CTS;
       nextUCS = cmd;
       break;
     default:
-      Serial.println("UserInterface: rts {Enable, Disable} not found");
+      UiOut.println("UserInterface: rts {Enable, Disable} not found");
       nextUCS = cmd;
     }
     #ifdef DEBUG
-    snprintf(Msg, 80, "UserInterface: case cts: after switch(Token[0])");
-    Serial.println(Msg);
+    UiOut.println("UserInterface: case cts: after switch(Token[0])");
     #endif
     break; // case cts:
 
   case timeout: // wait for timeout in seconds
-    Token = GetNextToken("Enter Timeout in seconds");
+    Token = GetNextToken("Enter Timeout in seconds, 0 to 255");
     if (Token == NULL) {
       break;  // case timeout, stay in this state
     } else {
       unsigned long ulTimeout = strtoul(Token, &endptr, 10);
-      if (endptr == Token) {
-        #ifdef DEBUG
-        snprintf(Msg, 80, "UserInterface: user entry -%s- not an (unsigned long)", Token);
-        Serial.println(Msg);
-        #endif
+      if ((endptr == Token) || (ulTimeout > TIMEOUTMAX)) {
+        UiOut.PrintLine("UserInterface: timeout sec 0 to %u, not -%s-", TIMEOUTMAX, Token);
         nextUCS = cmd;
         break; // case timeout, start command over
       } else {
-        Config.Timeout = (unsigned int) ulTimeout;
+        Config.Timeout = (uint16_t) ulTimeout;
+        Edited |= CONF_TIMEOUT;
         nextUCS = cmd;
         break;
       }
     }
-    Serial.println("UserInterface: case timeout; after if(Token), should not get here;");
+    UiOut.println("UserInterface: case timeout; after if(Token), should not get here;");
     nextUCS = cmd;
     break; // switch(UCS) case timeout:
 
-  case display:
-    PrintConfig(Config);
+  case keyalive: // wait for the in-band key window in msec
+    Token = GetNextToken("Enter Keyalive in msec, 0 disables the serial key");
+    if (Token == NULL) {
+      break;
+    }
+    {
+      unsigned long ulKeyAlive = strtoul(Token, &endptr, 10);
+      if ((endptr == Token) || (ulKeyAlive > KEYALIVEMAX)) {
+        UiOut.PrintLine("UserInterface: keyalive msec 0 to %u, not -%s-", KEYALIVEMAX, Token);
+      } else {
+        Config.KeyAlive = (uint16_t) ulKeyAlive;
+        Edited |= CONF_KEYALIVE;
+      }
+    }
     nextUCS = cmd;
     break;
 
-  case Init: // initialize config from EEPROM
-    if (strcmp(Token, "Init")== 0) { // require whole token
-      Config = InitDefaultConfig();
-      nextUCS = cmd; 
+  case filter: // wait for key filter assert msec
+  case filterRel: // then release msec
+    Token = GetNextToken((UCS == filter) ? "Enter key filter assert msec, 0 to 50"
+                                         : "Enter key filter release msec, 0 to 50");
+    if (Token == NULL) {
       break;
-    }  
-    Serial.print("UserInterface: 'Init' command entry error -");
-    Serial.print(Token);
-    Serial.println("-");
-    nextUCS = cmd;
+    }
+    {
+      unsigned long ulFilter = strtoul(Token, &endptr, 10);
+      if ((endptr == Token) || (ulFilter > KEYFILTERMAX)) {
+        UiOut.PrintLine("UserInterface: filter msec 0 to %u, not -%s-", KEYFILTERMAX, Token);
+        nextUCS = cmd;
+      } else if (UCS == filter) {
+        FilterAssert = (uint8_t) ulFilter;  // applied with the release value
+        nextUCS = filterRel;
+      } else {
+        Config.KeyAssert  = FilterAssert;
+        Config.KeyRelease = (uint8_t) ulFilter;
+        Edited |= CONF_KEYFILTER;
+        nextUCS = cmd;
+      }
+    }
     break;
 
-  case Boot: // reboot as if from power up
-    if (strcmp(Token, "Boot") == 0) { // require whole token
-      _PROTECTED_WRITE(RSTCTRL.SWRR,1); 
-      nextUCS = cmd; // should not get here
+  case guard: // wait for CTS lead msec
+  case guardLag: // then lag msec
+    Token = GetNextToken((UCS == guard) ? "Enter CTS lead msec, 0 to 255"
+                                        : "Enter CTS lag msec, 0 to 255");
+    if (Token == NULL) {
       break;
-    }  
-    Serial.print("UserInterface: 'Boot' command entry error -");
-    Serial.print(Token);
-    Serial.println("-");
-    nextUCS = cmd;
+    }
+    {
+      unsigned long ulGuard = strtoul(Token, &endptr, 10);
+      if ((endptr == Token) || (ulGuard > CTSGUARDMAX)) {
+        UiOut.PrintLine("UserInterface: guard msec 0 to %u, not -%s-", CTSGUARDMAX, Token);
+        nextUCS = cmd;
+      } else if (UCS == guard) {
+        GuardLead = (uint8_t) ulGuard;  // applied with the lag value
+        nextUCS = guardLag;
+      } else {
+        Config.CTSLead = GuardLead;
+        Config.CTSLag  = (uint8_t) ulGuard;
+        Edited |= CONF_CTS;
+        nextUCS = cmd;
+      }
+    }
+    break;
+
+  case display: // paged, may take several passes
+    if (prevUCS != UCS) {
+      PageLine = 0;
+    }
+    if (UiOutLines(DisplayLine, PageLine)) {
+      nextUCS = cmd;
+    }
+    break;
+
+  case Init: // initialize config to defaults, whole token checked by cmd or ParseLine()
+    Config = InitDefaultConfig();
+    Edited |= CONF_ALL;
+    nextUCS = display; 
+    break;
+
+  case Boot: // reboot as if from power up, whole token checked by cmd or ParseLine()
+    HalReset(); 
+    nextUCS = cmd; // should not get here
     break;
 
-  case help:
-    PrintHelp();
+  case Save: // write pending changes to EEPROM without waiting
+    if (CommitConfig(pConfig, true)) {
+      UiOut.println("Config written to EEPROM");
+    } else {
+      UiOut.println("No changes to save");
+    }
     nextUCS = cmd;
+    break;
+
+  case stats: // optional 'reset' on the same line, printout paged
+    if (prevUCS != UCS) {
+      PageLine = 0;
+      if (StatsResetReq) {
+        StatsResetReq = false;
+        StatsReset();
+        UiOut.println("Stats cleared");
+        nextUCS = cmd;
+        break;
+      }
+    }
+    if (UiOutLines(StatsLine, PageLine)) {
+      nextUCS = cmd;
+    }
+    break;
+
+  case trace: // optional 'reset' on the same line, recording held while paged
+    if (prevUCS != UCS) {
+      PageLine = 0;
+      if (TraceResetReq) {
+        TraceResetReq = false;
+        TraceReset();
+        UiOut.println("Trace cleared");
+        nextUCS = cmd;
+        break;
+      }
+      TraceHold(true);
+    }
+    if (UiOutLines(TraceLine, PageLine)) {
+      TraceHold(false);
+      nextUCS = cmd;
+    }
+    break;
+
+  case help: // paged, may take several passes
+    if (prevUCS != UCS) {
+      PageLine = 0;
+    }
+    if (UiOutLines(HelpLine, PageLine)) {
+      nextUCS = cmd;
+    }
     break; // switch(UCS) case help:
 
   // ******** states that wait for arguments to user commands *********
@@ -327,8 +929,8 @@ void UserConfig(sConfig_t *pConfig) {
     }  
     { // enclosed because new variable declared in this case:
       int8_t StepIdxTmp = GetStepIdx(Token);
-      if (StepIdxTmp < 0) { // error detected, not value in range 0:3
-        Serial.println("UserInterface: invalid StepIdx");
+      if (StepIdxTmp < 0) { // error detected, not value in range 0:NSTEPS-1
+        UiOut.println("UserInterface: invalid StepIdx");
         nextUCS = cmd;
         break;
       }
@@ -338,7 +940,7 @@ void UserConfig(sConfig_t *pConfig) {
     }
 
   case stepArg: // wait for arguments to step command
-    Token = GetNextToken("stepArg: {Tx msec, Rx msec, Open or Closed on rx}");
+    Token = GetNextToken("stepArg: {Tx msec, Rx msec, After msec, Open or Closed on rx}");
     if (Token == NULL) {
       break;
     } 
@@ -351,61 +953,84 @@ void UserConfig(sConfig_t *pConfig) {
         case 'r':
           nextUCS = msec;
           break;
+        case 'a':
+          nextUCS = msec;
+          break;
         case 'o':
-          //Serial.println("UserInterface: StepState Open on RX");
+          //UiOut.println("UserInterface: StepState Open on RX");
           Config.Step[StepIdx].RxPolarity = OPEN;
+          Edited |= (CONF_STEP0 << StepIdx);
           nextUCS = cmd; // step # open, command complete
           break;
         case 'c':
-          //Serial.println("UserInterface: StepState Closed on RX");
+          //UiOut.println("UserInterface: StepState Closed on RX");
           Config.Step[StepIdx].RxPolarity = CLOSED;
+          Edited |= (CONF_STEP0 << StepIdx);
           nextUCS = cmd; // step # closed, command complete
           break;
         default:
-          Serial.println("UserInterface: invalid input to step command");
+          UiOut.println("UserInterface: invalid input to step command");
           break;
       } // switch (ArgChar)
     } 
+    if (nextUCS != msec) {
+      break;     // open, closed or invalid, no msec to read
+    }
+    [[fallthrough]]; // msec can follow on the same line
 
-  case msec: // wait for Tx or Rx delay msec, 0 to 255
-    Token = GetNextToken("enter msec, 0 to 255");
+  case msec: // wait for Tx or Rx delay msec, 0 to 6553.5
+    Token = GetNextToken("enter msec, 0 to 6553.5");
     if (Token == NULL) {
       break;
     }  
-    // Token should contain msec
-    lmsec = strtol(Token, &endptr, 10); 
-    if (endptr == Token) {
-      Serial.print("UserInterface: strtol(msec) failed, try again");
-      break;
-    }
-    if ((lmsec > 255) | (lmsec < 0)) {
-      Serial.println("UserInterface: Sequence delay msec out of range, try again");
-      break;
+    // Token should contain msec, one decimal at most, or Serial for 'after'
+    {
+      sTok_t Msec = {Token, (uint8_t) strlen(Token)};
+      if ((StepArg == 'a') && (tolower(Token[0]) == 's')) {
+        Units = STEPSERIAL;
+      } else if (!TokTenths(Msec, (StepArg == 'a') ? STEPSERIAL - 1 : STEPUNITS_MAX, Units)) {
+        UiOut.println("UserInterface: Sequence delay msec out of range, try again");
+        break;
+      }
     }
-    // valid lmsec, configure based on StepArg
+    // valid Units, configure based on StepArg
     switch (StepArg){
       case 't':
-        Config.Step[StepIdx].Tx_msec = (uint8_t) lmsec;
+        Config.Step[StepIdx].Tx_100us = Units;
+        Edited |= (CONF_STEP0 << StepIdx);
         nextUCS = cmd;
         break;
       case 'r':
-        Config.Step[StepIdx].Rx_msec = (uint8_t) lmsec;
+        Config.Step[StepIdx].Rx_100us = Units;
+        Edited |= (CONF_STEP0 << StepIdx);
+        nextUCS = cmd;
+        break;
+      case 'a':
+        if ((StepIdx == 0) || (StepIdx == NSTEPS - 1)) {
+          UiOut.println("UserInterface: first and last steps are serial");
+        } else {
+          Config.Step[StepIdx].Start_100us = Units;
+          Edited |= (CONF_STEP0 << StepIdx);
+        }
         nextUCS = cmd;
         break;
       default:
-        Serial.println("UserInterface: switch(StepArg), invalid StepArg");
+        UiOut.println("UserInterface: switch(StepArg), invalid StepArg");
     } // switch(StepArg)
     break; // case msec:
 
   default:
-    Serial.println("UserInterface: switch(UCS) reached default:");
+    UiOut.println("UserInterface: switch(UCS) reached default:");
     nextUCS = top;
 
   } // switch(UCS)
 
   // The user may have made changes to the config
-  Config.CRC16 = CalcCRC(Config);  // update CRC16
-  PutConfig(0, Config);  // write changed bytes of config to EEPROM
-  *pConfig = Config;  // Copy the new config to global config
+  // CRC and EEPROM write are deferred to CommitConfig() from loop()
+  if (Edited) {
+    *pConfig = Config;  // Copy the new config to global config
+    MarkConfigDirty(Edited);
+    PublishConfig(Config);  // sequencer takes it now in Rx, else at the next Rx
+  }
   return;
 } // UserConfig() 
\ No newline at end of file
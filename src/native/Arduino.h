@@ -0,0 +1,166 @@
+// Arduino.h stand-in for [env:native]
+// Just enough of the megaTinyCore API for the sequencer sources on Linux
+// Pins are bits in HalPortA/B/C, time is the simulated clock in HalNative.cpp,
+// Serial writes stdout and reads from HalSimSerialInput()
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH         1
+#define LOW          0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+#define HEX          16
+#define DEC          10
+
+#ifndef F_CPU
+#define F_CPU 20000000UL
+#endif
+#define E2END 255  // ATtiny1616 EEPROM, 256 bytes
+
+// megaTinyCore pin numbers, port * 8 + bit
+#define PIN_PA0  0
+#define PIN_PA1  1
+#define PIN_PA2  2
+#define PIN_PA3  3
+#define PIN_PA4  4
+#define PIN_PA5  5
+#define PIN_PA6  6
+#define PIN_PA7  7
+#define PIN_PB0  8
+#define PIN_PB1  9
+#define PIN_PB2  10
+#define PIN_PB3  11
+#define PIN_PB4  12
+#define PIN_PB5  13
+#define PIN_PC0  16
+#define PIN_PC1  17
+#define PIN_PC2  18
+#define PIN_PC3  19
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+
+// flash is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+typedef const char *PGM_P;
+#define pgm_read_byte(p) (*(const uint8_t *) (p))
+#define pgm_read_word(p) (*(const uint16_t *) (p))
+#define pgm_read_ptr(p)  (*(const void * const *) (p))
+#define strcpy_P     strcpy
+#define strncpy_P    strncpy
+#define strcmp_P     strcmp
+#define strcasecmp_P strcasecmp
+#define strlen_P     strlen
+#define memcpy_P     memcpy
+#define snprintf_P   snprintf
+#define vsnprintf_P  vsnprintf
+
+// interrupts never preempt on the host, ISRs run inside HalSimAdvance()
+#define cli()
+#define sei()
+#define noInterrupts()
+#define interrupts()
+
+void          pinMode(uint8_t Pin, uint8_t Mode);
+void          digitalWrite(uint8_t Pin, uint8_t Level);
+uint8_t       digitalRead(uint8_t Pin);
+#define       digitalWriteFast digitalWrite
+unsigned long millis();
+unsigned long micros();
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+
+class String {
+ public:
+  String(const char *s = "");
+  String(int Value, int Base = DEC);
+  String(unsigned int Value, int Base = DEC);
+  String(unsigned char Value, int Base = DEC);
+  String(long Value, int Base = DEC);
+  String(unsigned long Value, int Base = DEC);
+  const char *c_str() const { return Buf; }
+ private:
+  char Buf[24];
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *Buf, size_t Len);
+  size_t write(const char *s) { return write((const uint8_t *) s, strlen(s)); }
+  virtual int availableForWrite() { return 64; }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper *s);
+  size_t print(const String &s);
+  size_t print(const char s[]);
+  size_t print(char c);
+  size_t print(unsigned char n, int Base = DEC);
+  size_t print(int n, int Base = DEC);
+  size_t print(unsigned int n, int Base = DEC);
+  size_t print(long n, int Base = DEC);
+  size_t print(unsigned long n, int Base = DEC);
+  size_t println(const __FlashStringHelper *s);
+  size_t println(const String &s);
+  size_t println(const char s[]);
+  size_t println(char c);
+  size_t println(unsigned char n, int Base = DEC);
+  size_t println(int n, int Base = DEC);
+  size_t println(unsigned int n, int Base = DEC);
+  size_t println(long n, int Base = DEC);
+  size_t println(unsigned long n, int Base = DEC);
+  size_t println(void);
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// stdout for output, HalSimSerialInput() queues input
+// TX ring of SERIAL_TX_BUFFER_SIZE drains at the baud rate in simulated time,
+// write() to a full ring waits like the core, with the interrupts running
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+class NativeSerial : public Stream {
+ public:
+  void   begin(unsigned long Baud);
+  int    available();
+  int    read();
+  int    peek();
+  size_t write(uint8_t c);
+  using  Print::write;
+  int    availableForWrite();
+};
+extern NativeSerial Serial;
+
+// sketch entry points, called from native/NativeMain.cpp
+void setup();
+void loop();
+
+#endif
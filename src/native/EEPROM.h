@@ -0,0 +1,42 @@
+// EEPROM.h stand-in for [env:native]
+// RAM backed, starts erased to 0xFF as after programming
+// Mem gives tests the raw bytes
+
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <Arduino.h>
+
+class EEPROMClass {
+ public:
+  EEPROMClass() : Writes(0) {
+    memset(Mem, 0xFF, sizeof(Mem));
+    memset(CellWrites, 0, sizeof(CellWrites));
+  }
+  uint8_t  read(int Addr)               { return Mem[Addr]; }
+  void     write(int Addr, uint8_t Val) { Mem[Addr] = Val; Writes++; CellWrites[Addr]++; }
+  void     update(int Addr, uint8_t Val) {
+    if (Mem[Addr] != Val) {
+      write(Addr, Val);
+    }
+  }
+  template <class T> T &get(int Addr, T &t) {
+    memcpy((void *) &t, &Mem[Addr], sizeof(T));
+    return t;
+  }
+  template <class T> const T &put(int Addr, const T &t) {
+    const uint8_t *p = (const uint8_t *) &t;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      update(Addr + i, p[i]);
+    }
+    return t;
+  }
+  uint16_t length() { return E2END + 1; }
+
+  uint8_t  Mem[E2END + 1];
+  uint32_t Writes;  // byte writes, for wear checks
+  uint32_t CellWrites[E2END + 1];  // writes to each byte, test_wear
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,436 @@
+// Hardware abstraction, Linux stand-ins for [env:native]
+// Ports are plain structs, time is a simulated clock that only moves in
+// delay() and HalSimAdvance(), the tick, step deadline and Tx timeout "interrupts"
+// run inside HalSimAdvance() at their exact simulated times
+// Also the Arduino core pieces declared in native/Arduino.h
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "StepTimer.h"
+#include "SequencerStateMachine.h"
+#include <EEPROM.h>
+
+sHalPort_t  HalPortA, HalPortB, HalPortC;
+NativeSerial Serial;
+EEPROMClass  EEPROM;
+
+static uint64_t Now_ns;                 // simulated time since power up
+
+static void   (*TickCallback)() = NULL; // HalTickInit(), NULL while HalTickSet(0)
+static void   (*TickHandler)()  = NULL;
+static uint64_t NextTick_ns;
+static uint64_t TickPeriod_ns;
+
+static void   (*AtEvent)() = NULL;      // HalSimAt(), a pin edge or serial byte from outside
+static uint64_t AtEvent_ns;
+static void   (*ProbeCallback)() = NULL; // HalSimProbe()
+
+static bool     TimeoutArmed;           // HalTimeoutArm(), RTC compare pending
+static uint64_t TimeoutAt;              // RTC count at expiry, counts since power up
+static uint64_t TimeoutDeadline_ns();
+
+static bool     StepArmed;              // StepTimerArm() deadline pending
+static bool     StepDone = true;
+static uint64_t StepDeadline_ns;
+
+static bool     SerialEcho = true;      // Serial output to stdout
+static void   (*SerialTap)(uint8_t) = NULL; // HalSimSerialTap()
+static uint32_t SerialByte_ns = 173611; // 10 bits at 57600 baud
+static uint16_t SerialTxLevel;          // bytes in the TX ring
+static uint64_t SerialTxDrain_ns;       // SerialTxLevel last brought up to date
+static char     SerialIn[256];          // HalSimSerialInput() queue
+static uint16_t SerialHead, SerialTail;
+
+// ******** pins ********
+static sHalPort_t *PinPort(uint8_t Pin) {
+  switch (Pin >> 3) {
+    case 0:  return &HalPortA;
+    case 1:  return &HalPortB;
+    default: return &HalPortC;
+  }
+}
+
+void pinMode(uint8_t Pin, uint8_t Mode) {
+  sHalPort_t *Port = PinPort(Pin);
+  uint8_t bm = 1 << (Pin & 7);
+  if (Mode == OUTPUT) {
+    Port->DIR |= bm;
+  } else {
+    Port->DIR &= ~bm;
+    if (Mode == INPUT_PULLUP) {
+      Port->IN |= bm;                   // nothing connected, pulled high
+    }
+  }
+}
+
+void digitalWrite(uint8_t Pin, uint8_t Level) {
+  sHalPort_t *Port = PinPort(Pin);
+  uint8_t bm = 1 << (Pin & 7);
+  if (Level) {
+    Port->OUT |= bm;
+  } else {
+    Port->OUT &= ~bm;
+  }
+}
+
+uint8_t digitalRead(uint8_t Pin) {
+  sHalPort_t *Port = PinPort(Pin);
+  uint8_t bm = 1 << (Pin & 7);
+  return ((Port->DIR & bm) ? Port->OUT : Port->IN) & bm ? HIGH : LOW;
+}
+
+// ******** time ********
+static bool     MillisStopped;          // HalCycleInit(), stop_millis() on the AVR
+static uint64_t MillisStop_ns;
+
+unsigned long millis() {
+  return (unsigned long) ((MillisStopped ? MillisStop_ns : Now_ns) / 1000000);
+}
+
+unsigned long micros() {
+  return (unsigned long) (Now_ns / 1000);
+}
+
+void delay(unsigned long ms) {
+  HalSimAdvance((uint64_t) ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  HalSimAdvance((uint64_t) us * 1000);
+}
+
+// run every interrupt due before Now_ns + ns, in time order
+// at the same time, an outside event, then the step deadline, Tx timeout and tick
+void HalSimAdvance(uint64_t ns) {
+  uint64_t End_ns = Now_ns + ns;
+  for (;;) {
+    enum { NONE, AT, STEP, TIMEOUT, TICK } Next = NONE;
+    uint64_t Next_ns = End_ns + 1;
+    if ((AtEvent != NULL) && (AtEvent_ns < Next_ns)) {
+      Next    = AT;
+      Next_ns = AtEvent_ns;
+    }
+    if (StepArmed && (StepDeadline_ns < Next_ns)) {
+      Next    = STEP;
+      Next_ns = StepDeadline_ns;
+    }
+    if (TimeoutArmed && (TimeoutDeadline_ns() < Next_ns)) {
+      Next    = TIMEOUT;
+      Next_ns = TimeoutDeadline_ns();
+    }
+    if ((TickCallback != NULL) && (NextTick_ns < Next_ns)) {
+      Next    = TICK;
+      Next_ns = NextTick_ns;
+    }
+    if (Next == NONE) {
+      break;
+    }
+    Now_ns = Next_ns;
+    if (Next == AT) {
+      void (*Event)() = AtEvent;
+      AtEvent = NULL;
+      Event();
+    } else if (Next == STEP) {
+      StepArmed = false;
+      StepDone  = true;
+      StepDeadlineISR();                // may arm the next step
+    } else if (Next == TIMEOUT) {
+      TimeoutArmed = false;
+      TxTimeoutISR();
+    } else {
+      NextTick_ns += TickPeriod_ns;
+      TickCallback();
+    }
+    if (ProbeCallback != NULL) {
+      ProbeCallback();
+    }
+  }
+  Now_ns = End_ns;
+}
+
+void HalSimAt(uint64_t At_ns, void (*Event)()) {
+  AtEvent_ns = At_ns;
+  AtEvent    = Event;
+}
+
+void HalSimProbe(void (*Probe)()) {
+  ProbeCallback = Probe;
+}
+
+uint64_t HalSimNow() {
+  return Now_ns;
+}
+
+// ******** HAL ********
+void HalTickInit(void (*Callback)()) {
+  TickHandler = Callback;
+  HalTickSet(TIMER1_INTERVAL_MS);
+}
+
+// restarts the period from now, like the TCB1 counter reset
+void HalTickSet(uint8_t Interval_ms) {
+  TickCallback = NULL;
+  if (Interval_ms == 0) {
+    return;
+  }
+  TickCallback  = TickHandler;
+  TickPeriod_ns = (uint64_t) Interval_ms * 1000000;
+  NextTick_ns   = Now_ns + TickPeriod_ns;
+}
+
+void HalKeyEdgesInit() {
+}
+
+// simulated time does not move inside an interrupt, so execution times read 0
+// millis() stops here as on the AVR, HalTime() is the clock from now on
+void HalCycleInit() {
+  MillisStopped = true;
+  MillisStop_ns = Now_ns;
+}
+
+uint16_t HalCycles() {
+  return (uint16_t) (Now_ns / HALCYCLE_NSEC);
+}
+
+// wraps like the AVR counter, a 24 hour run crosses it about 50 times
+HalTime_t HalTime() {
+  return (HalTime_t) (Now_ns / HALCYCLE_NSEC);
+}
+
+// Key and RTS inputs, low true like the hardware, edges call KeyEdgeISR()
+static void SetInput(sHalPort_t &Port, uint8_t bm, bool Level) {
+  bool Was = Port.IN & bm;
+  if (Level) {
+    Port.IN |= bm;
+  } else {
+    Port.IN &= ~bm;
+  }
+  if (Was != Level) {
+    KeyEdgeISR();
+  }
+}
+
+void HalSimSetKey(bool Level) {
+  SetInput(HALKEYPORT, KEYPIN_bm, Level);
+}
+
+void HalSimSetRTS(bool Level) {
+  SetInput(HALRTSPORT, RTSPIN_bm, Level);
+}
+
+// sleep until the next interrupt, as the AVR IDLE sleep, not at all with serial input waiting
+// The TCA0 overflow for HalTime() wakes it every HALCYCLE_WRAPMSEC at the latest
+void HalIdle() {
+  if (ProbeCallback != NULL) {
+    ProbeCallback();                    // loop() code may have changed outputs
+  }
+  if (Serial.available()) {
+    HalSimAdvance(100000);              // the AVR does not sleep with input waiting, loop() polls
+    return;
+  }
+  const uint64_t Wrap_ns = 65536ULL * HALCYCLE_NSEC;
+  uint64_t Next_ns = (Now_ns / Wrap_ns + 1) * Wrap_ns;
+  if ((TickCallback != NULL) && (NextTick_ns < Next_ns)) {
+    Next_ns = NextTick_ns;
+  }
+  if (StepArmed && (StepDeadline_ns < Next_ns)) {
+    Next_ns = StepDeadline_ns;
+  }
+  if ((AtEvent != NULL) && (AtEvent_ns < Next_ns)) {
+    Next_ns = AtEvent_ns;
+  }
+  if (TimeoutArmed && (TimeoutDeadline_ns() < Next_ns)) {
+    Next_ns = TimeoutDeadline_ns();
+  }
+  HalSimAdvance(Next_ns - Now_ns);
+}
+
+// no way back to setup() on the host, exit like a power down
+void HalReset() {
+  fflush(stdout);
+  exit(0);
+}
+
+// no stack to measure on the host
+void StackPaint() {
+}
+
+uint16_t StackUnused() {
+  return 0;
+}
+
+// ******** Tx timeout, in place of the RTC ********
+// counts HALTIMEOUT_PER_SEC from power up, arm and expiry as in HalAvr.cpp
+static uint64_t RtcCount() {
+  return Now_ns * HALTIMEOUT_PER_SEC / 1000000000;
+}
+
+static uint64_t TimeoutDeadline_ns() {
+  return (TimeoutAt * 1000000000 + HALTIMEOUT_PER_SEC - 1) / HALTIMEOUT_PER_SEC;
+}
+
+void HalTimeoutInit() {
+  TimeoutArmed = false;
+}
+
+void HalTimeoutArm(uint8_t Seconds) {
+  TimeoutAt    = RtcCount() + (uint16_t) Seconds * HALTIMEOUT_PER_SEC + 1;
+  TimeoutArmed = true;
+}
+
+void HalTimeoutStop() {
+  TimeoutArmed = false;
+}
+
+uint16_t HalTimeoutLeft() {
+  return (TimeoutArmed && (TimeoutAt > RtcCount())) ? (uint16_t) (TimeoutAt - RtcCount()) : 0;
+}
+
+// ******** step deadline, in place of TCB0 in StepTimer.cpp ********
+void StepTimerInit() {
+  StepArmed = false;
+  StepDone  = true;
+}
+
+void StepTimerArm(uint32_t Ticks) {
+  if (Ticks == 0) {
+    StepArmed = false;
+    StepDone  = true;
+    return;
+  }
+  StepArmed       = true;
+  StepDone        = false;
+  StepDeadline_ns = Now_ns + (uint64_t) Ticks * 1000000 / STEPTICKS_PER_MSEC;
+}
+
+bool StepTimerDone() {
+  return StepDone;
+}
+
+// ******** serial ********
+void HalSimSerialBytes(const uint8_t *Buf, uint16_t Len) {
+  while (Len--) {
+    uint16_t Next = (SerialHead + 1) % sizeof(SerialIn);
+    if (Next == SerialTail) {
+      break;                            // full, drop like an overrun
+    }
+    SerialIn[SerialHead] = (char) *Buf++;
+    SerialHead = Next;
+  }
+}
+
+void HalSimSerialInput(const char *s) {
+  HalSimSerialBytes((const uint8_t *) s, strlen(s));
+}
+
+void HalSimSerialEcho(bool Echo) {
+  SerialEcho = Echo;
+}
+
+void HalSimSerialTap(void (*Tap)(uint8_t c)) {
+  SerialTap = Tap;
+}
+
+void NativeSerial::begin(unsigned long Baud) {
+  SerialByte_ns = 10000000000ULL / Baud;
+}
+
+// bytes sent since the last look leave the TX ring
+static void SerialTxDrain() {
+  uint64_t Sent = (Now_ns - SerialTxDrain_ns) / SerialByte_ns;
+  if (Sent >= SerialTxLevel) {
+    SerialTxLevel    = 0;
+    SerialTxDrain_ns = Now_ns;
+  } else {
+    SerialTxLevel    -= Sent;
+    SerialTxDrain_ns += Sent * SerialByte_ns;
+  }
+}
+
+int NativeSerial::availableForWrite() {
+  SerialTxDrain();
+  return SERIAL_TX_BUFFER_SIZE - SerialTxLevel;
+}
+
+int NativeSerial::available() {
+  return (SerialHead - SerialTail + sizeof(SerialIn)) % sizeof(SerialIn);
+}
+
+int NativeSerial::read() {
+  if (SerialHead == SerialTail) {
+    return -1;
+  }
+  char c = SerialIn[SerialTail];
+  SerialTail = (SerialTail + 1) % sizeof(SerialIn);
+  return (uint8_t) c;
+}
+
+int NativeSerial::peek() {
+  return (SerialHead == SerialTail) ? -1 : (uint8_t) SerialIn[SerialTail];
+}
+
+size_t NativeSerial::write(uint8_t c) {
+  while (availableForWrite() == 0) {
+    HalSimAdvance(SerialByte_ns);       // blocked until a byte goes out
+  }
+  SerialTxLevel++;
+  if (SerialTap != NULL) {
+    SerialTap(c);
+  }
+  if (SerialEcho) {
+    putchar(c);
+  }
+  return 1;
+}
+
+// ******** Print and String ********
+static void FormatNumber(char *Buf, size_t Len, unsigned long n, bool Negative, int Base) {
+  if (Base == HEX) {
+    snprintf(Buf, Len, "%lX", n);
+  } else {
+    snprintf(Buf, Len, Negative ? "-%lu" : "%lu", n);
+  }
+}
+
+static void FormatSigned(char *Buf, size_t Len, long n, int Base) {
+  if ((Base == HEX) || (n >= 0)) {
+    FormatNumber(Buf, Len, (unsigned long) n, false, Base);
+  } else {
+    FormatNumber(Buf, Len, 0UL - (unsigned long) n, true, Base);
+  }
+}
+
+String::String(const char *s)                    { snprintf(Buf, sizeof(Buf), "%s", s); }
+String::String(int Value, int Base)              { FormatSigned(Buf, sizeof(Buf), Value, Base); }
+String::String(long Value, int Base)             { FormatSigned(Buf, sizeof(Buf), Value, Base); }
+String::String(unsigned int Value, int Base)     { FormatNumber(Buf, sizeof(Buf), Value, false, Base); }
+String::String(unsigned char Value, int Base)    { FormatNumber(Buf, sizeof(Buf), Value, false, Base); }
+String::String(unsigned long Value, int Base)    { FormatNumber(Buf, sizeof(Buf), Value, false, Base); }
+
+size_t Print::write(const uint8_t *Buf, size_t Len) {
+  size_t n = 0;
+  while (Len--) {
+    n += write(*Buf++);
+  }
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *s) { return write((const char *) s); }
+size_t Print::print(const String &s)              { return write(s.c_str()); }
+size_t Print::print(const char s[])               { return write(s); }
+size_t Print::print(char c)                       { return write((uint8_t) c); }
+size_t Print::print(unsigned char n, int Base)    { return print(String(n, Base)); }
+size_t Print::print(int n, int Base)              { return print(String(n, Base)); }
+size_t Print::print(unsigned int n, int Base)     { return print(String(n, Base)); }
+size_t Print::print(long n, int Base)             { return print(String(n, Base)); }
+size_t Print::print(unsigned long n, int Base)    { return print(String(n, Base)); }
+size_t Print::println(void)                       { return write("\n"); }
+size_t Print::println(const __FlashStringHelper *s) { return print(s) + println(); }
+size_t Print::println(const String &s)            { return print(s) + println(); }
+size_t Print::println(const char s[])             { return print(s) + println(); }
+size_t Print::println(char c)                     { return print(c) + println(); }
+size_t Print::println(unsigned char n, int Base)  { return print(n, Base) + println(); }
+size_t Print::println(int n, int Base)            { return print(n, Base) + println(); }
+size_t Print::println(unsigned int n, int Base)   { return print(n, Base) + println(); }
+size_t Print::println(long n, int Base)           { return print(n, Base) + println(); }
+size_t Print::println(unsigned long n, int Base)  { return print(n, Base) + println(); }
@@ -0,0 +1,19 @@
+#ifndef HALNATIVE_H
+#define HALNATIVE_H
+
+#include <Arduino.h>
+
+// Simulation controls for [env:native], HalNative.cpp
+// The simulated clock only moves in delay() and HalSimAdvance()
+void     HalSimAdvance(uint64_t ns);          // run the tick and step deadline interrupts due
+uint64_t HalSimNow();                         // nsec since power up
+void     HalSimSetKey(bool Level);            // KEYPIN level, low is keyed, edge runs KeyEdgeISR()
+void     HalSimSetRTS(bool Level);            // RTSPIN level, low is keyed
+void     HalSimAt(uint64_t At_ns, void (*Event)()); // one external event at HalSimNow() time At_ns
+void     HalSimProbe(void (*Probe)());        // after each interrupt and on HalIdle(), NULL for none
+void     HalSimSerialInput(const char *s);    // queue characters for Serial.read()
+void     HalSimSerialBytes(const uint8_t *Buf, uint16_t Len); // queue binary input, HostLink frames
+void     HalSimSerialEcho(bool Echo);         // false drops Serial output, for benchmarks
+void     HalSimSerialTap(void (*Tap)(uint8_t c)); // every byte written to Serial, NULL for none
+
+#endif
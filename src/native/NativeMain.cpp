@@ -0,0 +1,432 @@
+// Host entry point for [env:native]
+//   program        key sequence trace, microbenchmarks, RTS and in-band key latency,
+//                  tick rate and loop() wakes by state, build with -DTICK_RX_MS= etc. to
+//                  compare settings, key filter false keying on a noisy KEYPIN against added latency
+//   program run    interactive, stdin lines go to the user interface
+// The pass or fail checks are in test/, 'pio test -e native', which builds
+// src/ without this main()
+// Runs the unmodified setup(), SequencerISR(), StateMachine() and UserConfig()
+// on the simulated pins and clock in HalNative.cpp
+#ifndef PIO_UNIT_TESTING
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "SimProbe.h"
+#include "HardwareConfig.h"
+#include "SequencerStateMachine.h"
+#include "UserInterface.h"
+#include "SoftwareConfig.h"
+#include "HostLink.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "UiOut.h"
+#include "Global.h"
+#include <time.h>
+#include <math.h>
+
+// advance in 10 usec steps, print every change of the step outputs
+static void TraceOutputs(uint32_t usec) {
+  static uint8_t Prev = 0xFF;
+  for (uint32_t t = 0; t < usec; t += 10) {
+    HalSimAdvance(10000);
+    uint8_t Bits = StepBits();
+    if (Bits != Prev) {
+      printf("  %10.3f msec  outputs", HalSimNow() / 1e6);
+      for (uint8_t k = 0; k < NSTEPS; k++) {
+        printf(" %d", (Bits >> k) & 1);
+      }
+      printf("  state %u\n", StateMachineState());
+      Prev = Bits;
+    }
+  }
+}
+
+static double WallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(const char *Name, unsigned long Count, double Seconds) {
+  printf("%-36s %10lu in %6.3f sec, %8.2f M/sec\n", Name, Count, Seconds, Count / Seconds / 1e6);
+}
+
+static void KeyTrace() {
+  TraceOutputs(100000);  // ticks see the key released, arms the Tx timeout
+  printf("Key down, relay config as loaded\n");
+  HalSimSetKey(LOW);
+  TraceOutputs(1200000);
+  printf("Key up\n");
+  HalSimSetKey(HIGH);
+  TraceOutputs(1200000);
+  printf("Key down, up again after 15 msec\n");
+  HalSimSetKey(LOW);
+  TraceOutputs(15000);
+  HalSimSetKey(HIGH);
+  TraceOutputs(1200000);
+  printf("Key to output latency %u usec, max %u usec\n", KeyLatency(), MaxKeyLatency());
+  char Line[UIOUT_LINELEN];
+  for (uint8_t Index = 0; TraceLine(Index, Line); Index++) {
+    printf("%s\n", Line);              // what the 'trace' command prints
+  }
+}
+
+static void Benchmarks() {
+  const unsigned long N = 2000000;
+  double t;
+
+  // tick interrupt alone, idle in Rx
+  t = WallSeconds();
+  for (unsigned long i = 0; i < N; i++) {
+    SequencerISR();
+  }
+  Report("SequencerISR, Rx idle", N, WallSeconds() - t);
+
+  // state machine passes, key toggled every 8 passes
+  t = WallSeconds();
+  for (unsigned long i = 0; i < N; i++) {
+    StateMachine(GlobalConf, (i >> 3) & 1);
+  }
+  Report("StateMachine, key every 8 passes", N, WallSeconds() - t);
+
+  // simulated 10 msec ticks with key edges, deadlines and interrupts in time order
+  t = WallSeconds();
+  for (unsigned long i = 0; i < N; i++) {
+    if ((i & 31) == 0) {
+      HalSimSetKey((i >> 5) & 1);
+    }
+    HalSimAdvance((uint64_t) TIMER1_INTERVAL_MS * 1000000);
+  }
+  Report("Simulated ticks, key every 320 msec", N, WallSeconds() - t);
+  HalSimSetKey(HIGH);
+
+  // user interface passes, output dropped
+  const unsigned long M = N / 4;
+  HalSimSerialEcho(false);
+  t = WallSeconds();
+  for (unsigned long i = 0; i < M; i++) {
+    if (Serial.available() == 0) {
+      HalSimSerialInput("s 1 t 12\r");
+    }
+    if (UiOut.availableForWrite() < UIOUT_PASSROOM) {
+      HalSimAdvance(20000000);          // TX ring drains, as between loop() passes
+    }
+    HostLinkPoll(&GlobalConf);
+    UserConfig(&GlobalConf);
+  }
+  HalSimSerialEcho(true);
+  Report("UserConfig passes, step edits", M, WallSeconds() - t);
+}
+
+// ******** key latency through loop(), RTS pin against in-band key bytes ********
+static uint8_t  ProbeBits;
+static uint64_t Change_ns;              // first step output change after the stimulus
+
+static void OutputProbe() {
+  if ((Change_ns == 0) && (StepBits() != ProbeBits)) {
+    Change_ns = HalSimNow();
+  }
+}
+
+static void RTSDown() { HalSimSetRTS(LOW); }
+static void RTSUp()   { HalSimSetRTS(HIGH); }
+static void ByteDown() {
+  uint8_t b = LINK_KEYDOWN;
+  HalSimSerialBytes(&b, 1);
+}
+static void ByteUp() {
+  uint8_t b = LINK_KEYUP;
+  HalSimSerialBytes(&b, 1);
+}
+
+// stimulus at Delay_ns, time to the first output change, sequence left to finish
+static uint64_t KeyEdgeLatency(void (*Stimulus)(), uint64_t Delay_ns, uint64_t Wire_ns) {
+  uint64_t At_ns = HalSimNow() + Delay_ns;
+  ProbeBits = StepBits();
+  Change_ns = 0;
+  HalSimAt(At_ns + Wire_ns, Stimulus);  // a byte is in the RX ring once its stop bit is in
+  while (Change_ns == 0) {
+    loop();
+  }
+  for (uint8_t i = 0; i < 16; i++) {
+    loop();                             // 4 steps of 75 msec
+  }
+  return Change_ns - At_ns;
+}
+
+static void KeyBench(const char *Name, void (*Down)(), void (*Up)(), uint64_t Wire_ns) {
+  const unsigned N = 100;
+  uint64_t Sum = 0, Max = 0;
+  for (unsigned i = 0; i < N; i++) {
+    uint64_t Delay_ns = (uint64_t) ((i * 7919) % 30000) * 1000;  // across the loop() pass
+    uint64_t Lat = KeyEdgeLatency((i & 1) ? Up : Down, Delay_ns, Wire_ns);
+    Sum += Lat;
+    if (Lat > Max) {
+      Max = Lat;
+    }
+  }
+  printf("%-36s mean %7.1f usec, max %7.1f usec\n", Name, Sum / N / 1e3, Max / 1e3);
+}
+
+static void KeyLatencyBench() {
+  sConfig_t Config = GlobalConf;
+  Config.RTSEnable = true;
+  Config.KeyAlive  = 1000;
+  GlobalConf = Config;
+  PublishConfig(Config);
+  UserConfigSync(Config);
+  HalSimSerialEcho(false);
+  HalSimProbe(OutputProbe);
+  for (uint8_t i = 0; i < 4; i++) {
+    loop();                             // ISR takes the published config in Rx
+  }
+  StatsReset();
+  printf("Key to first output, host send to relay, through loop() passes\n");
+  printf("USB adapters add 1 to 16 msec to RTS, modem status batching, not simulated\n");
+  KeyBench("RTS pin edge", RTSDown, RTSUp, 0);
+  KeyBench("In-band key byte, 174 usec on wire", ByteDown, ByteUp, 10000000000ULL / 57600);
+
+  // dead-man, key byte with no refresh
+  ProbeBits = StepBits();
+  uint64_t Start_ns = HalSimNow();
+  ByteDown();
+  while (StateMachineState() == 0) {
+    loop();
+  }
+  while (StepBits() != ProbeBits) {
+    loop();
+  }
+  printf("In-band key, no refresh, back in Rx after %.0f msec, KeyAlive %u msec, expiries %u\n",
+         (HalSimNow() - Start_ns) / 1e6, Config.KeyAlive, SerialKeyExpiries());
+  char Line[UIOUT_LINELEN];
+  for (uint8_t Index = 0; StatsLine(Index, Line); Index++) {
+    printf("%s\n", Line);              // 'stats' over the latency runs, simulated code takes no time
+  }
+  HalSimProbe(NULL);
+  HalSimSerialEcho(true);
+}
+
+// ******** adaptive tick, interrupts per second by state and the timing they buy ********
+static uint64_t ExpiredAt_ns;           // serial key dead-man fired
+static uint16_t ExpiredWas;
+
+static void DeadManProbe() {
+  StateProbe();
+  if ((ExpiredAt_ns == 0) && (SerialKeyExpiries() != ExpiredWas)) {
+    ExpiredAt_ns = HalSimNow();
+  }
+}
+
+static uint32_t IsrCount() {
+  sStats_t S;
+  StatsGet(STAT_ISR, S);
+  return S.Count;
+}
+
+// sequencer interrupts per second over Seconds of simulated time, STAT_ISR
+static void TickRate(const char *Name, uint32_t Seconds) {
+  uint32_t Count = IsrCount();
+  HalSimAdvance((uint64_t) Seconds * 1000000000);
+  printf("  %-34s %7.1f ISR/sec\n", Name, (double) (IsrCount() - Count) / Seconds);
+}
+
+static void TickBench() {
+  sConfig_t Config = GlobalConf;
+  Config.Timeout  = 2;                  // sec
+  Config.KeyAlive = 1000;               // msec
+  GlobalConf = Config;
+  PublishConfig(Config);
+  UserConfigSync(Config);
+  double StepsUp = 0;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    StepsUp += Config.Step[k].Tx_100us / (double) STEPUNITS_PER_MSEC;
+  }
+  HalSimProbe(DeadManProbe);
+  HalSimAdvance(100000000);             // ISR takes the published config in Rx
+  printf("Tick by state, TICK_RX_MS %u, TICK_STEP_MS %u, TICK_TX_MS %u\n",
+         TICK_RX_MS, TICK_STEP_MS, TICK_TX_MS);
+  TickRate("Rx, unkeyed", 10);
+
+  // key to Tx, steps end on the deadline, the tick only samples, both counted
+  uint64_t Start_ns = HalSimNow();
+  uint32_t Count = IsrCount();
+  HalSimSetKey(LOW);
+  double Up = TimeToState(STATE_TX, Start_ns);
+  printf("  %-34s %7.1f ISR/sec, %u interrupts\n", "Stepping to Tx",
+         (IsrCount() - Count) * 1000 / Up, IsrCount() - Count);
+  printf("  %-34s %7.3f msec, steps %.1f msec\n", "Key to Tx", Up, StepsUp);
+  TickRate("Tx, keyed", 1);
+
+  // Tx timeout, RTC watchdog, no tick in Tx
+  double Out = TimeToState((State_t) (STATE_TX + 1), Start_ns);
+  printf("  %-34s %+7.3f msec, Timeout %u sec\n", "Tx timeout error", Out - Config.Timeout * 1000.0,
+         Config.Timeout);
+  TimeToState(STATE_RX, Start_ns);
+  TickRate("Rx, timed out, key held", 2);
+  HalSimSetKey(HIGH);
+  HalSimAdvance(100000000);
+  TickRate("Rx, key released", 2);
+
+  // serial key dead-man, no refresh
+  ExpiredWas   = SerialKeyExpiries();
+  ExpiredAt_ns = 0;
+  uint8_t b = LINK_KEYDOWN;
+  HalSimSerialBytes(&b, 1);
+  Start_ns = HalSimNow();
+  while (Serial.available()) {
+    loop();                             // HostLinkPoll() takes the byte
+  }
+  while (ExpiredAt_ns == 0) {
+    HalSimAdvance(1000000);
+  }
+  printf("  %-34s %+7.3f msec, KeyAlive %u msec\n", "In-band key dead-man error",
+         (ExpiredAt_ns - Start_ns) / 1e6 - Config.KeyAlive, Config.KeyAlive);
+  TimeToState(STATE_RX, Start_ns);
+  HalSimProbe(NULL);
+}
+
+// ******** sleep, loop() wakes per second in each state, 'stats' on the AVR ********
+static void RunLoop(uint32_t ms) {
+  uint64_t End_ns = HalSimNow() + (uint64_t) ms * 1000000;
+  while (HalSimNow() < End_ns) {
+    loop();
+  }
+}
+
+// Rx, key held short of the Tx timeout, Rx again, wakes counted by StatsIdle()
+// simulated code takes no time, so asleep reads 100% and the current is the IDLE figure
+static void SleepBench() {
+  HalSimSerialEcho(false);
+  RunLoop(100);
+  StatsReset();
+  RunLoop(10000);
+  HalSimSetKey(LOW);
+  RunLoop(GlobalConf.Timeout ? GlobalConf.Timeout * 1000 - 500 : 10000);
+  HalSimSetKey(HIGH);
+  RunLoop(10000);
+  printf("Sleep in loop(), wakes by state, TICK_RX_MS %u, TICK_STEP_MS %u, TICK_TX_MS %u\n",
+         TICK_RX_MS, TICK_STEP_MS, TICK_TX_MS);
+  char Line[UIOUT_LINELEN];
+  uint8_t Lines = 0;
+  while (StatsLine(Lines, Line)) {
+    Lines++;
+  }
+  for (uint8_t Index = Lines - WAKE_COUNT; Index < Lines; Index++) {
+    StatsLine(Index, Line);
+    printf("  %s\n", Line);
+  }
+  HalSimSerialEcho(true);
+}
+
+// ******** key filter, false keying from a noisy KEYPIN against the latency it adds ********
+static uint32_t NoiseSeed;
+static uint16_t StateExits;             // Rx or Tx left during a noise run
+static State_t  ProbeState;
+
+static void ExitProbe() {
+  State_t Now = StateMachineState();
+  if ((Now != ProbeState) && ((ProbeState == STATE_RX) || (ProbeState == STATE_TX))) {
+    StateExits++;
+  }
+  ProbeState = Now;
+}
+
+// 0 to 1, repeatable from run to run
+static double NoiseRand() {
+  NoiseSeed = NoiseSeed * 1664525 + 1013904223;
+  return ((NoiseSeed >> 8) + 0.5) / 16777216.0;
+}
+
+// RF pickup on the opto input, pulses to Level from the resting level,
+// 20 per second, exponential widths, 300 usec mean, returns the state exits
+static uint16_t NoiseRun(bool Level, uint32_t Seconds) {
+  uint64_t End_ns = HalSimNow() + (uint64_t) Seconds * 1000000000;
+  ProbeState = StateMachineState();
+  StateExits = 0;
+  HalSimProbe(ExitProbe);
+  while (HalSimNow() < End_ns) {
+    HalSimAdvance((uint64_t) (-log(NoiseRand()) * 50e6));
+    HalSimSetKey(Level);
+    HalSimAdvance((uint64_t) (-log(NoiseRand()) * 300e3) + 1000);
+    HalSimSetKey(!Level);
+  }
+  HalSimProbe(NULL);
+  return StateExits;
+}
+
+static void FilterBench() {
+  static const uint8_t Setting[][2] = {{0, 0}, {1, 1}, {2, 5}, {5, 10}, {10, 20}};
+  const uint32_t Seconds = 60;
+  printf("Key filter, KEYPIN pulses 20/sec, 300 usec mean width, %u sec keyed and unkeyed\n",
+         (unsigned) Seconds);
+  printf("  assert release   false keys  false unkeys   key latency  unkey latency  rejected\n");
+  for (uint8_t i = 0; i < sizeof(Setting) / sizeof(Setting[0]); i++) {
+    sConfig_t Config  = GlobalConf;
+    Config.Timeout    = 0;
+    Config.KeyAssert  = Setting[i][0];
+    Config.KeyRelease = Setting[i][1];
+    GlobalConf = Config;
+    PublishConfig(Config);              // taken at the first edge in Rx
+    UserConfigSync(Config);
+    NoiseSeed = 12345;
+    uint16_t Glitches = KeyGlitches();
+
+    uint16_t FalseKeys = NoiseRun(LOW, Seconds);
+    HalSimAdvance(1000000000);          // any false sequence back to Rx
+
+    HalSimProbe(StateProbe);
+    uint64_t Start_ns = HalSimNow();
+    HalSimSetKey(LOW);
+    double KeyLat = TimeToState(STATE_RX + 1, Start_ns);
+    TimeToState(STATE_TX, Start_ns);
+    HalSimProbe(NULL);
+
+    uint16_t FalseUnkeys = NoiseRun(HIGH, Seconds);
+    HalSimAdvance(1000000000);
+
+    HalSimProbe(StateProbe);
+    Start_ns = HalSimNow();
+    HalSimSetKey(HIGH);
+    double UnkeyLat = TimeToState(STATE_TX + 1, Start_ns);
+    TimeToState(STATE_RX, Start_ns);
+    HalSimProbe(NULL);
+
+    printf("  %3u    %3u    %6.1f/min    %6.1f/min   %7.3f msec  %7.3f msec   %6u\n",
+           Setting[i][0], Setting[i][1], FalseKeys * 60.0 / Seconds, FalseUnkeys * 60.0 / Seconds,
+           KeyLat, UnkeyLat, (uint16_t) (KeyGlitches() - Glitches));
+  }
+}
+
+// stdin lines to Serial, the sketch loop() runs until end of input
+static void Interactive() {
+  char Line[82];
+  for (;;) {
+    loop();
+    if (Serial.available() == 0) {
+      fflush(stdout);
+      if (fgets(Line, sizeof(Line), stdin) == NULL) {
+        for (uint8_t i = 0; i < 8; i++) {
+          loop();             // finish the last command
+        }
+        break;
+      }
+      HalSimSerialInput(Line);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  setup();
+  if ((argc > 1) && (strcmp(argv[1], "run") == 0)) {
+    Interactive();
+    return 0;
+  }
+  KeyTrace();
+  Benchmarks();
+  KeyLatencyBench();
+  TickBench();
+  SleepBench();
+  FilterBench();
+  return 0;
+}
+#endif
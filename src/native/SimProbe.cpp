@@ -0,0 +1,52 @@
+// Probes on the simulated pins and clock for the benchmarks and tests
+// A probe set with HalSimProbe() runs after each simulated interrupt
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "HardwareConfig.h"
+#include "SimProbe.h"
+
+static uint64_t StateAt_ns;             // first pass in StateWant
+static State_t  StateWant;
+
+uint8_t StepBits() {
+  uint8_t Bits = 0;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    if ((HalPortA.OUT & StepPinMap::A[k]) ||
+        (HalPortB.OUT & StepPinMap::B[k]) ||
+        (HalPortC.OUT & StepPinMap::C[k])) {
+      Bits |= 1 << k;
+    }
+  }
+  return Bits;
+}
+
+void StateProbe() {
+  if ((StateAt_ns == 0) && (StateMachineState() == StateWant)) {
+    StateAt_ns = HalSimNow();
+  }
+}
+
+// advance until the machine is about to run State, msec from Start_ns
+// the probe in place must call StateProbe()
+static double AdvanceToState(State_t State, uint64_t Start_ns, uint64_t Step_ns) {
+  StateWant  = State;
+  StateAt_ns = 0;
+  StateProbe();                         // a pin edge may have got there already
+  while (StateAt_ns == 0) {
+    HalSimAdvance(Step_ns);
+  }
+  return (StateAt_ns - Start_ns) / 1e6;
+}
+
+double TimeToState(State_t State, uint64_t Start_ns) {
+  return AdvanceToState(State, Start_ns, 100000);
+}
+
+double LongToState(State_t State, uint64_t Start_ns) {
+  return AdvanceToState(State, Start_ns, 10000000);
+}
+
+void Hold(double ms) {
+  HalSimAdvance((uint64_t) (ms * 1e6 + 0.5));
+}
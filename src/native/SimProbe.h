@@ -0,0 +1,15 @@
+#ifndef SIMPROBE_H
+#define SIMPROBE_H
+
+#include <Arduino.h>
+#include "SequencerStateMachine.h"
+
+// Probes on the simulated pins and clock, shared by NativeMain.cpp and the
+// [env:native] tests in test/, SimProbe.cpp
+uint8_t StepBits();                                    // steps in Tx polarity on the pins, step 1 in bit 0
+void    StateProbe();                                  // HalSimProbe() callback for TimeToState()
+double  TimeToState(State_t State, uint64_t Start_ns); // 100 usec steps to State, msec from Start_ns
+double  LongToState(State_t State, uint64_t Start_ns); // the same in 10 msec steps, for timeouts
+void    Hold(double ms);                               // advance the simulated clock
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SIMCHECK_H
+#define SIMCHECK_H
+
+// Check and report for the [env:native] tests, 'pio test -e native'
+// Every check prints ok or FAIL with what it measured, a failed check does
+// not stop the test case, tearDown() fails the case once with the count
+// Each test_ directory is its own program, main() runs setup() first,
+// then SimConfigure() for the config the suite runs on
+
+#include <unity.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "HalNative.h"
+#include "SoftwareConfig.h"
+#include "SequencerStateMachine.h"
+#include "UserInterface.h"
+#include "Global.h"
+
+// step times, 100 usec units, distinct per step, Tx 100 msec, Rx 120 msec over four steps
+static const uint16_t SimTx[] = {100, 200, 300, 400};
+static const uint16_t SimRx[] = {150, 250, 350, 450};
+
+static uint16_t CheckFails;
+
+static void Check(bool Pass, const char *Format, ...) {
+  va_list Args;
+  va_start(Args, Format);
+  printf("  %s ", Pass ? "ok  " : "FAIL");
+  vprintf(Format, Args);
+  printf("\n");
+  va_end(Args);
+  if (!Pass) {
+    CheckFails++;
+  }
+}
+
+// Config in place as a user edit leaves it, CRC, GlobalConf, the ISR and the UI copy
+static inline void SimPublish(sConfig_t Config) {
+  Config.CRC16 = CalcCRC(Config);
+  GlobalConf = Config;
+  PublishConfig(Config);
+  UserConfigSync(Config);
+}
+
+// GlobalConf with step k timed Tx[k % 4] and Rx[k % 4], NULL keeps the times,
+// every step serial, no key filter, Config.Timeout sec
+// Serial output off, Probe after each simulated interrupt, NULL for none
+static inline void SimConfigure(const uint16_t *Tx, const uint16_t *Rx, uint8_t Timeout, void (*Probe)()) {
+  sConfig_t Config = GlobalConf;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    if (Tx != NULL) {
+      Config.Step[k].Tx_100us = Tx[k % 4];
+      Config.Step[k].Rx_100us = Rx[k % 4];
+    }
+    Config.Step[k].Start_100us = STEPSERIAL;
+  }
+  Config.Timeout    = Timeout;
+  Config.KeyAssert  = 0;
+  Config.KeyRelease = 0;
+  SimPublish(Config);
+  HalSimSerialEcho(false);
+  HalSimProbe(Probe);
+}
+
+void setUp() {
+  CheckFails = 0;
+}
+
+void tearDown() {
+  TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, CheckFails, "checks failed, FAIL lines above");
+}
+
+#endif
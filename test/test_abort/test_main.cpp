@@ -0,0 +1,185 @@
+// Key change part way through the step chain, time back to Rx or on to Tx
+// With FASTABORT a relay waits only for the part of its move it made,
+// without it every move takes its full step time
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "SimProbe.h"
+#include "SequencerStateMachine.h"
+#include "SoftwareConfig.h"
+#include "UserInterface.h"
+#include "Global.h"
+#include <math.h>
+#include "../SimCheck.h"
+
+// ms into step k of the forward chain
+static double ForwardAt(uint8_t k, double Fraction) {
+  double t = 0;
+  for (uint8_t j = 0; j < k; j++) {
+    t += SimTx[j % 4] / 10.0;
+  }
+  return t + Fraction * SimTx[k % 4] / 10.0;
+}
+
+// Expected with FASTABORT, Full without
+static void AbortCheck(const char *Name, double Measured, double Expected, double Full) {
+  bool Pass = fabs(Measured - (FASTABORT ? Expected : Full)) <= 0.2;  // one 100 usec unit each way
+  Check(Pass, "%-28s %8.1f msec, expected %8.1f, full waits %8.1f", Name, Measured, Expected, Full);
+}
+
+// step output edges, msec after the key, for the start interlocks
+static uint64_t RelayKey_ns;
+static uint8_t  RelayBits;
+static double   RelayOn[NSTEPS];
+static double   RelayOff[NSTEPS];
+
+static void RelayProbe() {
+  StateProbe();
+  uint8_t Bits = StepBits();
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    if (((Bits ^ RelayBits) >> k) & 1) {
+      double t = (HalSimNow() - RelayKey_ns) / 1e6;
+      if ((Bits >> k) & 1) {
+        RelayOn[k] = t;
+      } else {
+        RelayOff[k] = t;
+      }
+    }
+  }
+  RelayBits = Bits;
+}
+
+// Start_100us of steps 1 to NSTEPS - 2, key to Tx and unkey to Rx against the serial chain
+// The last step asserts when every relay before it is done and releases before any of them
+static void ParallelRun(const char *Name, uint16_t Start, double TxExpected, double RxExpected) {
+  sConfig_t Config = GlobalConf;
+  for (uint8_t k = 1; k < NSTEPS - 1; k++) {
+    Config.Step[k].Start_100us = (k == 2) ? Start : STEPSERIAL;
+  }
+  SimPublish(Config);
+  Hold(10);
+  RelayBits   = StepBits();
+  RelayKey_ns = HalSimNow();
+  HalSimSetKey(LOW);
+  RelayProbe();                         // outputs the key edge interrupt drove
+  double On = TimeToState(STATE_TX, RelayKey_ns);
+  Hold(10);
+  RelayKey_ns = HalSimNow();
+  HalSimSetKey(HIGH);
+  RelayProbe();
+  double Off = TimeToState(STATE_RX, RelayKey_ns);
+  double Serial = ForwardAt(NSTEPS, 0);
+  double SerialRx = 0;
+  bool   Order = true;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    SerialRx += SimRx[k % 4] / 10.0;
+  }
+  for (uint8_t k = 0; k < NSTEPS - 1; k++) {
+    Order = Order && (RelayOn[NSTEPS - 1] + 0.2 >= RelayOn[k] + SimTx[k % 4] / 10.0) &&
+            (RelayOff[k] + 0.2 >= RelayOff[NSTEPS - 1] + SimRx[(NSTEPS - 1) % 4] / 10.0);
+  }
+  printf("%s\n", Name);
+  AbortCheck("key to Tx", On, TxExpected, TxExpected);
+  AbortCheck("unkey to Rx", Off, RxExpected, RxExpected);
+  printf("  serial chain %.1f msec to Tx, %.1f to Rx\n", Serial, SerialRx);
+  Check(Order, "last step on after the others are done, off before any");
+}
+
+static const double Fraction[] = {0.0, 0.25, 0.5, 0.9};
+
+// key up during SkT, relay k undoes what it did, relays below it all of theirs
+static void test_key_up_forward() {
+  char Name[40];
+  printf("Key up during the forward chain, time back to Rx\n");
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    for (uint8_t f = 0; f < 4; f++) {
+      HalSimSetKey(LOW);
+      Hold(ForwardAt(k, Fraction[f]));
+      HalSimSetKey(HIGH);
+      double Back = TimeToState(STATE_RX, HalSimNow());
+      double Expected = Fraction[f] * SimRx[k % 4] / 10.0;
+      double Full = SimRx[k % 4] / 10.0;
+      for (uint8_t j = 0; j < k; j++) {
+        Expected += SimRx[j % 4] / 10.0;
+        Full     += SimRx[j % 4] / 10.0;
+      }
+      snprintf(Name, sizeof(Name), "S%uT at %2.0f%%", k + 1, Fraction[f] * 100);
+      AbortCheck(Name, Back, Expected, Full);
+      Hold(10);
+    }
+  }
+
+}
+
+// key down again during SkR, relay k redoes what it undid, relays above it all of theirs
+static void test_key_down_reverse() {
+  char Name[40];
+  printf("Key down during the reverse chain, time on to Tx\n");
+  for (uint8_t k = NSTEPS; k-- > 0;) {
+    for (uint8_t f = 0; f < 4; f++) {
+      HalSimSetKey(LOW);
+      TimeToState(STATE_TX, HalSimNow());
+      Hold(10);
+      HalSimSetKey(HIGH);
+      double t = 0;
+      for (uint8_t j = NSTEPS - 1; j > k; j--) {
+        t += SimRx[j % 4] / 10.0;
+      }
+      Hold(t + Fraction[f] * SimRx[k % 4] / 10.0);
+      HalSimSetKey(LOW);
+      double On = TimeToState(STATE_TX, HalSimNow());
+      double Expected = Fraction[f] * SimTx[k % 4] / 10.0;
+      double Full = SimTx[k % 4] / 10.0;
+      for (uint8_t j = k + 1; j < NSTEPS; j++) {
+        Expected += SimTx[j % 4] / 10.0;
+        Full     += SimTx[j % 4] / 10.0;
+      }
+      snprintf(Name, sizeof(Name), "S%uR at %2.0f%%", k + 1, Fraction[f] * 100);
+      AbortCheck(Name, On, Expected, Full);
+      HalSimSetKey(HIGH);
+      TimeToState(STATE_RX, HalSimNow());
+      Hold(10);
+    }
+  }
+
+}
+
+// tap during a tap, S2T half way, back in S2R a quarter of the way, key again
+static void test_double_tap() {
+  printf("Key tapped twice, S2T half way, then S2R a quarter of its release\n");
+  HalSimSetKey(LOW);
+  Hold(ForwardAt(1, 0.5));
+  HalSimSetKey(HIGH);
+  Hold(SimRx[1] / 10.0 * 0.5 * 0.5);  // half of the half it moved
+  HalSimSetKey(LOW);
+  double On = TimeToState(STATE_TX, HalSimNow());
+  AbortCheck("S2T 50%, S2R 25%, to Tx", On, SimTx[1] / 10.0 * 0.75 + ForwardAt(NSTEPS, 0) - ForwardAt(2, 0),
+             ForwardAt(NSTEPS, 0) - ForwardAt(1, 0));
+  HalSimSetKey(HIGH);
+  TimeToState(STATE_RX, HalSimNow());
+
+}
+
+// steps 1 and 2 independent, 20 and 30 msec, step 2 with step 1 or just after it
+// S1T 10, S2T and S3T until the slower relay is done at 40, S4T 40, Tx at 80, serial 100
+// S4R 45 first, relays 2 and 1 back at 80 and 70, relay 0 after relay 1 at 85, serial 120
+static void test_parallel_starts() {
+  HalSimProbe(RelayProbe);
+  ParallelRun("Step 2 starts with step 1, 's 2 a 0'", 0, 80, 85);
+  ParallelRun("Step 2 starts 5 msec after step 1, 's 2 a 5'", 50, 85, 90);
+  ParallelRun("Serial, 's 2 a s'", STEPSERIAL, ForwardAt(NSTEPS, 0), 120);
+  HalSimProbe(StateProbe);
+}
+
+int main() {
+  setup();
+  SimConfigure(SimTx, SimRx, 0, StateProbe);
+  HalSimAdvance(100000000);             // ISR takes the published config in Rx
+  printf("Key change part way through each step, FASTABORT %d\n", FASTABORT);
+  UNITY_BEGIN();
+  RUN_TEST(test_key_up_forward);
+  RUN_TEST(test_key_down_reverse);
+  RUN_TEST(test_double_tap);
+  RUN_TEST(test_parallel_starts);
+  return UNITY_END();
+}
@@ -0,0 +1,184 @@
+// CTS, ready to modulate, against the relays
+// CTS edges and the first relay release timed from the key, the trace gives
+// their order inside one interrupt, where the simulated clock does not move
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "SimProbe.h"
+#include "SequencerStateMachine.h"
+#include "SoftwareConfig.h"
+#include "UserInterface.h"
+#include "Trace.h"
+#include "UiOut.h"
+#include "Global.h"
+#include <math.h>
+#include "../SimCheck.h"
+
+static uint64_t CtsMark_ns;
+static bool     CtsWas;
+static uint8_t  CtsBits;
+static double   CtsUpAt, CtsDownAt;     // msec after CtsMark_ns, -1 none
+static double   CtsRelayAt;             // first step output change after CtsMark_ns, -1 none
+
+static bool CtsPin() {
+  return (HalPortA.OUT & CTSPIN_bm) ? (CTS_UP == HIGH) : (CTS_UP == LOW);
+}
+
+static void CtsProbe() {
+  StateProbe();
+  double t = (HalSimNow() - CtsMark_ns) / 1e6;
+  if (CtsPin() != CtsWas) {
+    CtsWas = CtsPin();
+    (CtsWas ? CtsUpAt : CtsDownAt) = t;
+  }
+  if ((CtsRelayAt < 0) && (StepBits() != CtsBits)) {
+    CtsRelayAt = t;
+  }
+}
+
+static void CtsMark() {
+  CtsMark_ns = HalSimNow();
+  CtsUpAt    = -1;
+  CtsDownAt  = -1;
+  CtsRelayAt = -1;
+  CtsBits    = StepBits();
+}
+
+// key change, then the probe for the outputs the key edge interrupt drove
+static void CtsKey(bool Keyed) {
+  CtsMark();
+  HalSimSetKey(Keyed ? LOW : HIGH);
+  CtsProbe();
+}
+
+// in the trace since the last TraceReset(), CTS down comes before the first relay release
+static bool CtsFirst() {
+  char Line[UIOUT_LINELEN], Release[6];
+  StateName((State_t) (STATE_TX + 1), Release);
+  bool Down = false;
+  for (uint8_t Index = 1; TraceLine(Index, Line); Index++) {
+    Down = Down || (strstr(Line, "CTS down") != NULL);
+    if (strstr(Line, Release) != NULL) {
+      return Down;
+    }
+  }
+  return false;
+}
+
+static void CtsConfig(bool Enable, uint8_t Lead, uint8_t Lag, uint16_t Timeout) {
+  sConfig_t Config = GlobalConf;
+  Config.CTSEnable = Enable;
+  Config.CTSLead   = Lead;
+  Config.CTSLag    = Lag;
+  Config.Timeout   = Timeout;
+  SimPublish(Config);
+  Hold(10);                             // ISR takes the published config in Rx
+}
+
+// Key, Tx, unkey with the guard times, CTS edges and the first relay release against the key
+static void CtsRun(const char *Name, uint8_t Lead, uint8_t Lag) {
+  CtsConfig(true, Lead, Lag, 0);
+  printf("%s\n", Name);
+  CtsKey(true);
+  double Tx = TimeToState(STATE_TX, CtsMark_ns);
+  Hold(Lead + 10.0);
+  double Up = CtsUpAt;
+  Check(fabs(Up - (Tx + Lead)) < 0.01, "CTS up the lead time after Tx entry");
+  TraceReset();
+  CtsKey(false);
+  double Rx = TimeToState(STATE_RX, CtsMark_ns);
+  printf("  key to Tx %.1f msec, CTS up %.1f, unkey to CTS down %.1f, first relay %.1f, Rx %.1f\n",
+         Tx, Up, CtsDownAt, CtsRelayAt, Rx);
+  Check(CtsDownAt == 0, "CTS down with the key release");
+  Check(fabs(CtsRelayAt - Lag) < 0.01, "relays hold the lag time after CTS");
+  Check(CtsFirst(), "CTS down before the first relay release");
+}
+
+static void test_power_up() {
+  Check(!CtsPin(), "CTS down at power up");
+}
+
+static void test_lead_0_lag_0() {
+  CtsRun("Lead 0, lag 0", 0, 0);
+}
+
+static void test_lead_5_lag_10() {
+  CtsRun("Lead 5, lag 10", 5, 10);
+}
+
+static void test_key_back_during_lag() {
+  printf("Key back during the lag\n");
+  CtsConfig(true, 0, 10, 0);
+  CtsKey(true);
+  TimeToState(STATE_TX, CtsMark_ns);
+  Hold(10);
+  CtsKey(false);
+  Hold(5);
+  HalSimSetKey(LOW);
+  CtsProbe();
+  Hold(20);
+  Check((fabs(CtsUpAt - 5) < 0.01) && CtsPin() && (CtsRelayAt < 0) && (StateMachineState() == STATE_TX),
+        "CTS up again at once, relays never moved, still Tx");
+  CtsKey(false);
+  TimeToState(STATE_RX, CtsMark_ns);
+}
+
+static void test_key_up_during_lead() {
+  printf("Key released during the lead\n");
+  CtsConfig(true, 20, 10, 0);
+  CtsKey(true);
+  TimeToState(STATE_TX, CtsMark_ns);
+  Hold(5);
+  bool Early = (CtsUpAt < 0);
+  CtsKey(false);
+  TimeToState(STATE_RX, CtsMark_ns);
+  Check(Early && (CtsUpAt < 0) && (CtsRelayAt == 0), "CTS never up, relays release at once, no lag");
+}
+
+static void test_timeout_with_lag() {
+  printf("Tx timeout, 1 sec, lag 10\n");
+  CtsConfig(true, 0, 10, 1);
+  CtsKey(true);
+  TimeToState(STATE_TX, CtsMark_ns);
+  CtsBits    = StepBits();              // relays from Tx on
+  CtsRelayAt = -1;
+  TraceReset();
+  TimeToState((State_t) (STATE_TX + 1), CtsMark_ns);
+  printf("  key to CTS down %.1f msec, first relay %.1f\n", CtsDownAt, CtsRelayAt);
+  Check((CtsDownAt >= 1000) && (CtsDownAt <= 1000 + 1000.0 / HALTIMEOUT_PER_SEC), "CTS down at the timeout");
+  Check(fabs(CtsRelayAt - CtsDownAt - 10) < 0.01, "relays hold the lag time after CTS");
+  Check(CtsFirst(), "CTS down before the first relay release");
+  TimeToState(STATE_RX, CtsMark_ns);
+  HalSimSetKey(HIGH);
+  Hold(10);
+}
+
+static void test_cts_disabled() {
+  printf("CTS disabled\n");
+  CtsConfig(false, 0, 10, 0);
+  CtsKey(true);
+  TimeToState(STATE_TX, CtsMark_ns);
+  Hold(10);
+  bool Never = (CtsUpAt < 0);
+  CtsKey(false);
+  Hold(1);
+  Check(Never && (CtsUpAt < 0) && (CtsRelayAt == 0), "CTS never up, relays release at once, no lag");
+  TimeToState(STATE_RX, CtsMark_ns);
+  printf("Key release to CTS down %u usec, max %u usec, simulated code takes no time\n",
+         CTSLatency(), MaxCTSLatency());
+}
+
+int main() {
+  setup();
+  SimConfigure(SimTx, SimRx, 0, CtsProbe);
+  CtsWas = CtsPin();
+  UNITY_BEGIN();
+  RUN_TEST(test_power_up);
+  RUN_TEST(test_lead_0_lag_0);
+  RUN_TEST(test_lead_5_lag_10);
+  RUN_TEST(test_key_back_during_lag);
+  RUN_TEST(test_key_up_during_lead);
+  RUN_TEST(test_timeout_with_lag);
+  RUN_TEST(test_cts_disabled);
+  return UNITY_END();
+}
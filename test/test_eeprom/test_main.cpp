@@ -0,0 +1,254 @@
+// EEPROM layouts, what each older firmware left behind, upgraded by GetConfig()
+// The journal on the simulated EEPROM in src/native/EEPROM.h
+
+#include "Hal.h"
+#include "SoftwareConfig.h"
+#include "Config.h"
+#include <CRC.h>
+#include <EEPROM.h>
+#include "../SimCheck.h"
+
+static uint8_t  Before[E2END + 1];     // EEPROM before GetConfig()
+static uint16_t Size;                  // record size, the slot stride
+
+// old config with values from Seed, step times in msec, CRC16 set
+// V0.3 and version 1 have V03STEPS steps, version 2 NSTEPS
+template <typename Conf_t>
+static Conf_t OldConfig(uint8_t Seed) {
+  Conf_t Conf;
+  for (uint8_t k = 0; k < sizeof(Conf.Step) / sizeof(Conf.Step[0]); k++) {
+    Conf.Step[k].RxPolarity = (k & 1) ? CLOSED : OPEN;
+    Conf.Step[k].Tx_msec    = Seed + 10 * k;
+    Conf.Step[k].Rx_msec    = 255 - Seed - k;
+  }
+  Conf.RTSEnable = true;
+  Conf.CTSEnable = false;
+  Conf.Timeout   = 100 + Seed;
+  Conf.CRC16     = calcCRC16((const uint8_t *) &Conf, sizeof(Conf) - 2);
+  return Conf;
+}
+
+static sConfigV2_t OldConfigV2(uint8_t Seed) {
+  sConfigV2_t Conf = OldConfig<sConfigV2_t>(Seed);
+  Conf.KeyAlive = 700 + Seed;
+  Conf.CRC16    = calcCRC16((const uint8_t *) &Conf, sizeof(Conf) - 2);
+  return Conf;
+}
+
+// V0.3 steps as NSTEPS msec steps, the last one last, any between them 0 msec
+static sConfigV2_t FromV03(const sConfigV1_t &V1) {
+  sConfigV2_t Conf = {};
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Conf.Step[k].RxPolarity = OPEN;
+    Conf.Step[k].Tx_msec    = 0;
+    Conf.Step[k].Rx_msec    = 0;
+  }
+  for (uint8_t k = 0; (k < V03STEPS - 1) && (k < NSTEPS - 1); k++) {
+    Conf.Step[k] = V1.Step[k];
+  }
+  Conf.Step[NSTEPS - 1] = V1.Step[V03STEPS - 1];
+  Conf.RTSEnable = V1.RTSEnable;
+  Conf.CTSEnable = V1.CTSEnable;
+  Conf.Timeout   = V1.Timeout;
+  return Conf;
+}
+
+static sConfigV3_t OldConfigV3(uint8_t Seed) {
+  sConfigV2_t V2 = OldConfigV2(Seed);
+  sConfigV3_t Conf;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Conf.Step[k].RxPolarity = V2.Step[k].RxPolarity;
+    Conf.Step[k].Tx_100us   = V2.Step[k].Tx_msec * STEPUNITS_PER_MSEC;
+    Conf.Step[k].Rx_100us   = V2.Step[k].Rx_msec * STEPUNITS_PER_MSEC;
+  }
+  Conf.RTSEnable = V2.RTSEnable;
+  Conf.CTSEnable = V2.CTSEnable;
+  Conf.Timeout   = V2.Timeout;
+  Conf.KeyAlive  = V2.KeyAlive;
+  Conf.CRC16     = calcCRC16((const uint8_t *) &Conf, sizeof(Conf) - 2);
+  return Conf;
+}
+
+static sConfigV4_t OldConfigV4(uint8_t Seed) {
+  sConfigV3_t V3 = OldConfigV3(Seed);
+  sConfigV4_t Conf;
+  memcpy(Conf.Step, V3.Step, sizeof(Conf.Step));
+  Conf.RTSEnable  = V3.RTSEnable;
+  Conf.CTSEnable  = V3.CTSEnable;
+  Conf.Timeout    = V3.Timeout;
+  Conf.KeyAlive   = V3.KeyAlive;
+  Conf.KeyAssert  = 2 + Seed % 10;
+  Conf.KeyRelease = 5 + Seed % 20;
+  Conf.CRC16      = calcCRC16((const uint8_t *) &Conf, sizeof(Conf) - 2);
+  return Conf;
+}
+
+static sConfigV5_t OldConfigV5(uint8_t Seed) {
+  sConfigV4_t V4 = OldConfigV4(Seed);
+  sConfigV5_t Conf;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Conf.Step[k].RxPolarity  = V4.Step[k].RxPolarity;
+    Conf.Step[k].Tx_100us    = V4.Step[k].Tx_100us;
+    Conf.Step[k].Rx_100us    = V4.Step[k].Rx_100us;
+    Conf.Step[k].Start_100us = STEPSERIAL;
+  }
+  Conf.RTSEnable  = V4.RTSEnable;
+  Conf.CTSEnable  = true;
+  Conf.Timeout    = V4.Timeout;
+  Conf.KeyAlive   = V4.KeyAlive;
+  Conf.KeyAssert  = V4.KeyAssert;
+  Conf.KeyRelease = V4.KeyRelease;
+  Conf.CRC16      = calcCRC16((const uint8_t *) &Conf, sizeof(Conf) - 2);
+  return Conf;
+}
+
+// journal record as the old firmware wrote it, Seq, Version, Config, CRC16 over the rest
+// returns the record size, its slot stride
+template <typename Conf_t>
+static uint16_t OldRecord(uint8_t Slot, uint16_t Seq, uint8_t Version, const Conf_t &Conf) {
+  uint8_t Rec[sizeof(Conf_t) + 5];
+  Rec[0] = Seq & 0xFF;
+  Rec[1] = Seq >> 8;
+  Rec[2] = Version;
+  memcpy(&Rec[3], &Conf, sizeof(Conf));
+  uint16_t CRC = calcCRC16(Rec, sizeof(Rec) - 2);
+  Rec[sizeof(Rec) - 2] = CRC & 0xFF;
+  Rec[sizeof(Rec) - 1] = CRC >> 8;
+  memcpy(&EEPROM.Mem[Slot * sizeof(Rec)], Rec, sizeof(Rec));
+  return sizeof(Rec);
+}
+
+// migrated Config against the old msec values, NSTEPS of them, then the upgrade is in place:
+// the old record is untouched, and the next boot reads the new record without writing
+// KeyAssert and KeyRelease 0 for layouts before the key filter, CTS guard times always 0
+static void MigrateCheck(const sConfig_t &Config, const sConfigV2_t &Old, bool CTSEnable, uint16_t KeyAlive,
+                         uint8_t KeyAssert, uint8_t KeyRelease,
+                         uint16_t OldAddr, uint16_t OldSize, const uint8_t *Before) {
+  bool Same = (Config.RTSEnable == Old.RTSEnable) && (Config.CTSEnable == CTSEnable) &&
+              (Config.Timeout == ((Old.Timeout > TIMEOUTMAX) ? TIMEOUTMAX : Old.Timeout)) &&
+              (Config.KeyAlive == KeyAlive) &&
+              (Config.KeyAssert == KeyAssert) && (Config.KeyRelease == KeyRelease) &&
+              (Config.CTSLead == 0) && (Config.CTSLag == 0);
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    Same = Same && (Config.Step[k].RxPolarity == Old.Step[k].RxPolarity) &&
+           (Config.Step[k].Tx_100us == Old.Step[k].Tx_msec * STEPUNITS_PER_MSEC) &&
+           (Config.Step[k].Rx_100us == Old.Step[k].Rx_msec * STEPUNITS_PER_MSEC) &&
+           (Config.Step[k].Start_100us == STEPSERIAL);
+  }
+  Check(isConfigValid(Config) && Same, "values carried over, steps serial");
+  Check(memcmp(&EEPROM.Mem[OldAddr], &Before[OldAddr], OldSize) == 0, "old record intact");
+  uint32_t Writes = EEPROM.Writes;
+  sConfig_t Again = GetConfig();
+  Check((memcmp(&Again, &Config, sizeof(Config)) == 0) && (EEPROM.Writes == Writes),
+        "next boot reads the upgraded record, no writes");
+}
+
+static void test_layouts() {
+  printf("Layouts, V0.3 and version 1 %u bytes, version 2 %u, version 3 %u, version 4 %u, version 5 %u, "
+         "version %u %u\n",
+         (unsigned) sizeof(sConfigV1_t), (unsigned) sizeof(sConfigV2_t), (unsigned) sizeof(sConfigV3_t),
+         (unsigned) sizeof(sConfigV4_t), (unsigned) sizeof(sConfigV5_t), JOURNALVERSION,
+         (unsigned) sizeof(sConfig_t));
+  Check(sizeof(sConfigV1_t) == 18, "V0.3 layout, 4 steps whatever NSTEPS is");
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  Check(!isConfigValid(GetConfig()), "erased, no config");
+}
+
+static void test_v03_single_copy() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  sConfigV1_t V1 = OldConfig<sConfigV1_t>(20);
+  V1.Timeout = 300;                     // V0.3 took any 16 bit value, upgrade caps it
+  V1.CRC16   = calcCRC16((const uint8_t *) &V1, sizeof(V1) - 2);
+  memcpy(EEPROM.Mem, &V1, sizeof(V1));
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  MigrateCheck(GetConfig(), FromV03(V1), false, 0, 0, 0, 0, sizeof(V1), Before);
+}
+
+// sequence wrapped, newest in slot 4
+static void test_v1_journal() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  for (uint8_t Slot = 0; Slot < 5; Slot++) {
+    Size = OldRecord(Slot, 0xFFFE + Slot, 1, OldConfig<sConfigV1_t>(Slot));
+  }
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  MigrateCheck(GetConfig(), FromV03(OldConfig<sConfigV1_t>(4)), false, 0, 0, 0, 4 * Size, Size, Before);
+}
+
+// over a version 1 journal, newest torn
+static void test_v2_journal() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  for (uint8_t Slot = 0; Slot < 10; Slot++) {
+    OldRecord(Slot, 100 + Slot, 1, OldConfig<sConfigV1_t>(50 + Slot));
+  }
+  for (uint8_t Slot = 0; Slot < 4; Slot++) {
+    Size = OldRecord(Slot, 10 + Slot, 2, OldConfigV2(Slot));
+  }
+  EEPROM.Mem[3 * Size + 7] ^= 0x10;     // power lost writing slot 3
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  MigrateCheck(GetConfig(), OldConfig<sConfigV2_t>(2), false, OldConfigV2(2).KeyAlive, 0, 0, 2 * Size, Size,
+               Before);
+}
+
+// newest in the last slot
+static void test_v3_journal() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  uint8_t Slots = (E2END + 1) / (sizeof(sConfigV3_t) + 5);
+  for (uint8_t Slot = 0; Slot < Slots; Slot++) {
+    Size = OldRecord(Slot, 200 + Slot, 3, OldConfigV3(Slot));
+  }
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  MigrateCheck(GetConfig(), OldConfig<sConfigV2_t>(Slots - 1), false, OldConfigV2(Slots - 1).KeyAlive, 0, 0,
+               (Slots - 1) * Size, Size, Before);
+}
+
+// newest in slot 1, key filter kept
+static void test_v4_journal() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  for (uint8_t Slot = 0; Slot < 3; Slot++) {
+    Size = OldRecord(Slot, (Slot == 2) ? 0xFFF0 : Slot, 4, OldConfigV4(30 + Slot));
+  }
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  sConfigV4_t V4 = OldConfigV4(31);
+  MigrateCheck(GetConfig(), OldConfig<sConfigV2_t>(31), false, V4.KeyAlive, V4.KeyAssert, V4.KeyRelease,
+               Size, Size, Before);
+}
+
+// newest in slot 0, CTS enable kept, guard times 0
+static void test_v5_journal() {
+  memset(EEPROM.Mem, 0xFF, sizeof(EEPROM.Mem));
+  for (uint8_t Slot = 0; Slot < 4; Slot++) {
+    Size = OldRecord(Slot, (Slot == 0) ? 500 : 400 + Slot, 5, OldConfigV5(40 + Slot));
+  }
+  memcpy(Before, EEPROM.Mem, sizeof(Before));
+  sConfigV5_t V5 = OldConfigV5(40);
+  MigrateCheck(GetConfig(), OldConfig<sConfigV2_t>(40), true, V5.KeyAlive, V5.KeyAssert, V5.KeyRelease,
+               0, Size, Before);
+}
+
+// current version, edits after the upgrade round the ring and past the old records
+static void test_edits_after_upgrade() {
+  sConfig_t Config = GetConfig();
+  Config.Step[0].Tx_100us = 3;          // 0.3 msec, PIN diode switch
+  Config.Step[3].Rx_100us = 65000;      // 6.5 sec, vacuum relay
+  Config.CRC16 = CalcCRC(Config);
+  for (uint8_t i = 0; i < 20; i++) {
+    PutConfig(Config);
+  }
+  sConfig_t Back = GetConfig();
+  Check(isConfigValid(Back) && (Back.Step[0].Tx_100us == 3) && (Back.Step[3].Rx_100us == 65000),
+        "sub msec and long steps read back");
+}
+
+int main() {
+  setup();
+  UNITY_BEGIN();
+  RUN_TEST(test_layouts);
+  RUN_TEST(test_v03_single_copy);
+  RUN_TEST(test_v1_journal);
+  RUN_TEST(test_v2_journal);
+  RUN_TEST(test_v3_journal);
+  RUN_TEST(test_v4_journal);
+  RUN_TEST(test_v5_journal);
+  RUN_TEST(test_edits_after_upgrade);
+  return UNITY_END();
+}
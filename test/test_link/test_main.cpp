@@ -0,0 +1,277 @@
+// HostLink frames from the host tool side, what a PC program would do over the tty
+// The simulated serial port stands in for the tty, loop() runs the sequencer side
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "SequencerStateMachine.h"
+#include "SoftwareConfig.h"
+#include "HostLink.h"
+#include "Stats.h"
+#include "Global.h"
+#include "SimProbe.h"
+#include "UiOut.h"
+#include <CRC.h>
+#include "../SimCheck.h"
+
+static uint8_t  LinkRx[4096];  // everything the sequencer wrote, text and frames
+static uint16_t LinkRxLen;
+
+static void LinkTap(uint8_t c) {
+  if (LinkRxLen < sizeof(LinkRx)) {
+    LinkRx[LinkRxLen++] = c;
+  }
+}
+
+static uint16_t LinkFrame(uint8_t *Out, uint8_t Cmd, const void *Payload, uint8_t Len) {
+  Out[0] = LINK_SYNC;
+  Out[1] = Len;
+  Out[2] = Cmd;
+  if (Len) {
+    memcpy(&Out[3], Payload, Len);
+  }
+  uint16_t CRC = calcCRC16(&Out[1], Len + 2);
+  Out[Len + 3] = CRC & 0xFF;
+  Out[Len + 4] = CRC >> 8;
+  return Len + LINK_OVERHEAD;
+}
+
+// first whole frame with a good CRC in LinkRx, text before it skipped
+static bool LinkFind(uint8_t &Cmd, uint8_t *Payload, uint8_t &Len, uint16_t &Text) {
+  for (uint16_t i = 0; i + LINK_OVERHEAD <= LinkRxLen; i++) {
+    if (LinkRx[i] != LINK_SYNC) {
+      continue;
+    }
+    uint8_t n = LinkRx[i + 1];
+    if (i + n + LINK_OVERHEAD > LinkRxLen) {
+      return false;
+    }
+    uint16_t CRC = LinkRx[i + n + 3] | (LinkRx[i + n + 4] << 8);
+    if (calcCRC16(&LinkRx[i + 1], n + 2) != CRC) {
+      continue;
+    }
+    Cmd  = LinkRx[i + 2];
+    Len  = n;
+    Text = i;
+    memcpy(Payload, &LinkRx[i + 3], n);
+    return true;
+  }
+  return false;
+}
+
+// send Tx, run loop() until a reply frame is back, false after 50 passes
+static bool LinkTransact(const char *Name, const uint8_t *Tx, uint16_t TxLen,
+                         uint8_t &Cmd, uint8_t *Payload, uint8_t &Len) {
+  LinkRxLen = 0;
+  uint64_t Start = HalSimNow();
+  HalSimSerialBytes(Tx, TxLen);
+  uint16_t Text;
+  for (uint8_t Pass = 0; Pass < 50; Pass++) {
+    loop();
+    if (LinkFind(Cmd, Payload, Len, Text)) {
+      uint16_t Wire = TxLen + Len + LINK_OVERHEAD;
+      printf("%-28s %3u bytes out, %3u back, %3u on the wire, %5.1f msec at 57600, reply in %5.1f msec\n",
+             Name, TxLen, Len + LINK_OVERHEAD, Wire, Wire * 10 / 57.6, (HalSimNow() - Start) / 1e6);
+      return true;
+    }
+  }
+  printf("%-28s no reply\n", Name);
+  return false;
+}
+
+static uint8_t Tx[LINK_OVERHEAD + LINK_MAXLEN];
+static uint8_t Payload[LINK_MAXLEN];
+static uint8_t Cmd, Len;
+
+static void test_config_round_trip() {
+  uint16_t n = LinkFrame(Tx, LINK_GETCONFIG, NULL, 0);
+  Check(LinkTransact("get-config", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == (LINK_GETCONFIG | LINK_REPLY)) && (Len == sizeof(sConfig_t)) &&
+        (memcmp(Payload, &GlobalConf, sizeof(sConfig_t)) == 0), "config matches GlobalConf");
+
+  sConfig_t Config = GlobalConf;
+  Config.Step[0].Tx_100us = 7705;       // 770.5 msec
+  Config.Timeout         = 200;
+  Config.CRC16           = CalcCRC(Config);
+  n = LinkFrame(Tx, LINK_SETCONFIG, &Config, sizeof(Config));
+  Check(LinkTransact("set-config", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == (LINK_SETCONFIG | LINK_REPLY)) && (Len == 0), "acknowledged");
+  Check((GlobalConf.Step[0].Tx_100us == 7705) && (GlobalConf.Timeout == 200), "GlobalConf updated");
+  Check(ConfigDirtyFields() == CONF_ALL, "marked for EEPROM commit");
+
+  n = LinkFrame(Tx, LINK_GETCONFIG, NULL, 0);
+  Check(LinkTransact("get-config, after set", Tx, n, Cmd, Payload, Len) &&
+        (memcmp(Payload, &Config, sizeof(sConfig_t)) == 0), "reads back what was set");
+
+  sConfig_t Long = Config;
+  Long.Timeout = TIMEOUTMAX + 1;
+  Long.CRC16   = CalcCRC(Long);
+  n = LinkFrame(Tx, LINK_SETCONFIG, &Long, sizeof(Long));
+  Check(LinkTransact("set-config, timeout 256 sec", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == LINK_NAK) && (Payload[0] == LINK_ERR_CONFIG), "refused");
+  Check(GlobalConf.Timeout == 200, "GlobalConf kept");
+
+  Config.CRC16 ^= 1;
+  n = LinkFrame(Tx, LINK_SETCONFIG, &Config, sizeof(Config));
+  Check(LinkTransact("set-config, bad config CRC", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == LINK_NAK) && (Payload[0] == LINK_ERR_CONFIG), "refused");
+  Check(GlobalConf.Step[0].Tx_100us == 7705, "GlobalConf kept");
+}
+
+// a typed edit leaves the GlobalConf CRC stale until the commit, get-config
+// within the quiet window still sends a config set-config takes back
+static void test_get_after_edit() {
+  HalSimSerialInput("s 2 t 33.3\r");
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  Check((ConfigDirtyFields() != 0) && !isConfigValid(GlobalConf), "edit not committed yet, CRC stale");
+  uint16_t n = LinkFrame(Tx, LINK_GETCONFIG, NULL, 0);
+  sConfig_t Config;
+  Check(LinkTransact("get-config, after an edit", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == (LINK_GETCONFIG | LINK_REPLY)) && (Len == sizeof(Config)), "config");
+  memcpy(&Config, Payload, sizeof(Config));
+  Check(isConfigValid(Config) && (Config.Step[2].Tx_100us == 333), "CRC fresh, edit in it");
+
+  n = LinkFrame(Tx, LINK_SETCONFIG, &Config, sizeof(Config));
+  Check(LinkTransact("set-config, what was read", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == (LINK_SETCONFIG | LINK_REPLY)) && (Len == 0), "acknowledged");
+}
+
+static void test_errors_and_text() {
+  uint16_t n = LinkFrame(Tx, LINK_GETSTATUS, NULL, 0);
+  Tx[n - 1] ^= 0x55;
+  Check(LinkTransact("get-status, bad frame CRC", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == LINK_NAK) && (Payload[0] == LINK_ERR_CRC), "NAK CRC");
+
+  n = LinkFrame(Tx, 0x42, NULL, 0);
+  Check(LinkTransact("unknown command", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == LINK_NAK) && (Payload[0] == LINK_ERR_COMMAND), "NAK command");
+
+  // half a frame, the host gives up, typed text afterwards still works
+  n = LinkFrame(Tx, LINK_GETSTATUS, NULL, 0);
+  HalSimSerialBytes(Tx, 2);
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  LinkRxLen = 0;
+  HalSimSerialInput("d\r");
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  Check((LinkRxLen > 0) && (memmem(LinkRx, LinkRxLen, "User entered 'd'", 16) != NULL),
+        "text after an abandoned frame");
+
+  // text and a frame back to back in one burst
+  LinkRxLen = 0;
+  HalSimSerialInput("s 1 t 12.5\r");
+  n = LinkFrame(Tx, LINK_GETSTATUS, NULL, 0);
+  sLinkStatus_t Status;
+  Check(LinkTransact("get-status, behind a line", Tx, n, Cmd, Payload, Len) &&
+        (Cmd == (LINK_GETSTATUS | LINK_REPLY)) && (Len == sizeof(Status)), "status");
+  memcpy(&Status, Payload, sizeof(Status));
+  printf("  state %u, dirty 0x%03X, latency %u usec, max %u usec, dropped %u, link errors %u\n",
+         Status.State, Status.Dirty, Status.KeyLatency, Status.MaxKeyLatency, Status.Dropped,
+         Status.LinkErrors);
+  Check(GlobalConf.Step[1].Tx_100us == 125, "line before the frame applied");
+
+  // an offset on a serial step names the step
+  LinkRxLen = 0;
+  char Line[24];
+  snprintf(Line, sizeof(Line), "s %u a 5\r", NSTEPS - 1);
+  HalSimSerialInput(Line);
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  char Want[24];
+  snprintf(Want, sizeof(Want), "step %u is serial", NSTEPS - 1);
+  Check(memmem(LinkRx, LinkRxLen, Want, strlen(Want)) != NULL, "'s %u a 5' refused, step named", NSTEPS - 1);
+  Check(Status.LinkErrors == 5, "link errors, two config, CRC, command and timeout");
+
+  // a timeout past the 8 bit RTC arm is refused as typed too
+  LinkRxLen = 0;
+  HalSimSerialInput("t 300\r");
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  Check((memmem(LinkRx, LinkRxLen, "timeout seconds 0 to 255", 24) != NULL) && (GlobalConf.Timeout == 200),
+        "'t 300' refused");
+}
+
+static void test_stats() {
+  uint16_t n = LinkFrame(Tx, LINK_GETSTATS, NULL, 0);
+  Check(LinkTransact("get-stats", Tx, n, Cmd, Payload, Len) &&
+        (Len == STAT_COUNT * sizeof(sStats_t)), "one record per StatId");
+  sStats_t Loop;
+  memcpy(&Loop, &Payload[STAT_LOOP * sizeof(sStats_t)], sizeof(Loop));
+  printf("  loop passes %lu, max %u usec\n", (unsigned long) Loop.Count, Loop.Max);
+}
+
+// help text comes out whole, each line under UIOUT_LINELEN with its terminator
+static void test_help_lines() {
+  LinkRxLen = 0;
+  HalSimSerialInput("h\r");
+  for (uint16_t i = 0; i < 400; i++) {
+    loop();
+  }
+  // from the first help line to the prompt after it, the prompt is not a UiOut line
+  const uint8_t *Help   = (const uint8_t *) memmem(LinkRx, LinkRxLen, "This is help", 12);
+  uint16_t       First  = Help ? Help - LinkRx : LinkRxLen;
+  const uint8_t *Prompt = (const uint8_t *) memmem(&LinkRx[First], LinkRxLen - First, "Command list", 12);
+  uint16_t       Last   = Prompt ? Prompt - LinkRx : LinkRxLen;
+  uint16_t Longest = 0;
+  uint16_t Len     = 0;
+  for (uint16_t i = First; i < Last; i++) {
+    if ((LinkRx[i] == '\r') || (LinkRx[i] == '\n')) {
+      Len = 0;
+    } else if (++Len > Longest) {
+      Longest = Len;
+    }
+  }
+  printf("  %u bytes of help, longest line %u\n", Last - First, Longest);
+  Check(Longest < UIOUT_LINELEN - 1, "help lines fit, none cut at %u", UIOUT_LINELEN - 1);
+  Check((memmem(LinkRx, LinkRxLen, "before any apply", 16) != NULL) &&
+        (memmem(LinkRx, LinkRxLen, "timeouts, usec", 14) != NULL), "long lines whole");
+}
+
+// with TICK_RX_MS 0 nothing runs while idle in Rx, an edit has to reach the pins
+// and the serial key from the publish, not at the next key edge
+static void test_idle_publish() {
+  uint8_t Was = StepBits();
+  HalSimSerialInput((GlobalConf.Step[0].RxPolarity == OPEN) ? "s 0 c\r" : "s 0 o\r");
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  Check((StateMachineState() == STATE_RX) && ((StepBits() ^ Was) == 0x01),
+        "step 0 polarity on the pins while idle in Rx");
+
+  HalSimSerialInput("k 5000\r");
+  for (uint8_t i = 0; i < 8; i++) {
+    loop();
+  }
+  uint8_t Down = LINK_KEYDOWN;
+  HalSimSerialBytes(&Down, 1);
+  loop();
+  Check(StateMachineState() != STATE_RX, "in-band key down right after 'k 5000'");
+  uint8_t Up = LINK_KEYUP;
+  HalSimSerialBytes(&Up, 1);
+  loop();
+  HalSimAdvance(1000000000ULL);
+  Check(StateMachineState() == STATE_RX, "back in Rx after key up");
+}
+
+int main() {
+  setup();
+  HalSimSerialEcho(false);
+  HalSimSerialTap(LinkTap);
+  for (uint8_t i = 0; i < 4; i++) {
+    loop();                             // UI prompt out of the way
+  }
+  UNITY_BEGIN();
+  RUN_TEST(test_config_round_trip);
+  RUN_TEST(test_get_after_edit);
+  RUN_TEST(test_errors_and_text);
+  RUN_TEST(test_stats);
+  RUN_TEST(test_help_lines);
+  RUN_TEST(test_idle_publish);
+  return UNITY_END();
+}
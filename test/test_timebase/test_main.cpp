@@ -0,0 +1,122 @@
+// Timebase, a simulated day of Tx timeouts across the HalTime() wraps
+// The RTC watchdog against the simulated clock, and the HalTime() spans every
+// interrupt adds up, against the same clock
+
+#include "Hal.h"
+#include "HalNative.h"
+#include "SimProbe.h"
+#include "SequencerStateMachine.h"
+#include "SoftwareConfig.h"
+#include "Global.h"
+#include <math.h>
+#include "../SimCheck.h"
+
+static HalTime_t TimeLast;              // HalTime() at the previous interrupt
+static uint64_t  TimeSum;               // spans added up, HalTime() counts
+static uint16_t  TimeWraps;
+
+static void TimeProbe() {
+  StateProbe();
+  HalTime_t Now = HalTime();
+  TimeWraps += (Now < TimeLast);
+  TimeSum   += (HalTime_t) (Now - TimeLast);
+  TimeLast   = Now;
+}
+
+static const uint16_t Timeout = 60;    // sec, Timeout
+
+// Key held into the Tx timeout, released, again, for 24 hours of simulated time
+// The timeouts run on the RTC watchdog, HalTime() spans are added up at every interrupt,
+// so any loss per span would grow through the day
+static void test_day_of_timeouts() {
+  const uint32_t Hours = 24;
+  uint16_t Timeouts = TxTimeouts();
+
+  uint64_t Start_ns = HalSimNow();
+  uint64_t End_ns   = Start_ns + (uint64_t) Hours * 3600 * 1000000000;
+  TimeLast = HalTime();
+  TimeSum  = 0;
+  double   First = 0, Min = 1e9, Max = -1e9;
+  uint32_t Count = 0;
+  while (HalSimNow() < End_ns) {
+    uint64_t Key_ns = HalSimNow();
+    HalSimSetKey(LOW);
+    double Error = LongToState((State_t) (STATE_TX + 1), Key_ns) - Timeout * 1000.0;
+    First = Count ? First : Error;
+    Min   = (Error < Min) ? Error : Min;
+    Max   = (Error > Max) ? Error : Max;
+    Count++;
+    LongToState(STATE_RX, Key_ns);
+    HalSimSetKey(HIGH);
+    Hold(1000 + (Count * 7919) % 1000);  // key again at a varied point of the wrap
+  }
+  double Last = Max;
+  {
+    uint64_t Key_ns = HalSimNow();      // one more, the error at the end of the day
+    HalSimSetKey(LOW);
+    Last = LongToState((State_t) (STATE_TX + 1), Key_ns) - Timeout * 1000.0;
+    LongToState(STATE_RX, Key_ns);
+    HalSimSetKey(HIGH);
+    Hold(1000);
+  }
+  uint64_t Span_ns = (uint64_t) (HalTime_t) (HalTime() - TimeLast) + TimeSum;
+  Span_ns *= HALCYCLE_NSEC;
+  double   Drift   = ((double) Span_ns - (double) (HalSimNow() - Start_ns)) / 1e3;
+  printf("  %u hours, %lu timeouts, %u wraps\n", (unsigned) Hours, (unsigned long) Count, TimeWraps);
+  printf("  timeout error, first %+.3f, last %+.3f, min %+.3f, max %+.3f msec\n", First, Last, Min, Max);
+  printf("  HalTime() spans added up against the simulated clock %+.1f usec\n", Drift);
+  Check((Min >= 0) && (Max <= 1000.0 / HALTIMEOUT_PER_SEC), "every timeout within one RTC count late");
+  Check((Last >= Min) && (Last <= Max), "no drift, the last timeout within the first day's spread");
+  Check(fabs(Drift) < HALCYCLE_NSEC / 1e3, "spans add up to the clock, one count");
+  Check(TimeWraps >= Hours * 3600 / HALTIME_WRAPSEC, "the day crossed the wrap");
+  Check((uint16_t) (TxTimeouts() - Timeouts) == Count + 1, "every timeout counted once");
+}
+
+// 'display' readout, 20 sec into the key, then none once released
+static void test_time_left_readout() {
+  HalSimSetKey(LOW);
+  Hold(20000);
+  uint16_t Left = TxTimeoutLeft();
+  HalSimSetKey(HIGH);
+  LongToState(STATE_RX, HalSimNow());
+  printf("  20 sec into the key, Tx timeout in %u.%u sec, %u after release\n", Left / 10, Left % 10,
+         TxTimeoutLeft());
+  Check((Left >= (Timeout - 20) * 10) && (Left <= (Timeout - 20) * 10 + 1) && (TxTimeoutLeft() == 0),
+        "time left readout, rounded up");
+}
+
+// key 5 msec before the next wrap, the relay moves and deadlines run across it
+static void test_steps_across_wrap() {
+  double StepsUp = 0, StepsDown = 0;
+  for (uint8_t k = 0; k < NSTEPS; k++) {
+    StepsUp   += GlobalConf.Step[k].Tx_100us / (double) STEPUNITS_PER_MSEC;
+    StepsDown += GlobalConf.Step[k].Rx_100us / (double) STEPUNITS_PER_MSEC;
+  }
+  uint64_t Wrap_ns = ((HalSimNow() / HALCYCLE_NSEC >> 32) + 1) * (HALCYCLE_NSEC << 32);
+  HalSimAdvance(Wrap_ns - 5000000 - HalSimNow());
+  uint64_t Key_ns = HalSimNow();
+  HalSimSetKey(LOW);
+  double Up = TimeToState(STATE_TX, Key_ns);
+  Hold(10);
+  Key_ns = HalSimNow();
+  HalSimSetKey(HIGH);
+  double Down = TimeToState(STATE_RX, Key_ns);
+  printf("  across the wrap, key to Tx %.1f msec, steps %.1f, unkey to Rx %.1f, steps %.1f\n",
+         Up, StepsUp, Down, StepsDown);
+  Check((fabs(Up - StepsUp) <= 0.2) && (fabs(Down - StepsDown) <= 0.2), "step timing across the wrap");
+
+}
+
+int main() {
+  setup();
+  SimConfigure(NULL, NULL, Timeout, NULL);
+  HalSimAdvance(100000000);             // ISR takes the published config in Rx
+  printf("Timebase, HalTime() %u nsec per count, wraps every %lu sec, Tx timeout %u counts per sec\n",
+         (unsigned) HALCYCLE_NSEC, (unsigned long) HALTIME_WRAPSEC, HALTIMEOUT_PER_SEC);
+  HalSimProbe(TimeProbe);               // spans and states at every interrupt
+  UNITY_BEGIN();
+  RUN_TEST(test_day_of_timeouts);
+  RUN_TEST(test_time_left_readout);
+  RUN_TEST(test_steps_across_wrap);
+  return UNITY_END();
+}
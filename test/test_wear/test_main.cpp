@@ -0,0 +1,65 @@
+// EEPROM journal wear, millions of commits of a config edited each time,
+// on the RAM EEPROM in src/native/EEPROM.h, which counts writes per byte
+// No byte may be written more than once per slot in the ring, a single copy
+// at a fixed address would take every commit on its CRC
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unity.h>
+#include "Config.h"
+#include "SoftwareConfig.h"
+
+#define WEARCOMMITS   2000000UL
+#define WEARENDURANCE 100000UL                 // ATtiny1616 EEPROM erase/write cycles, datasheet
+#define WEARRECORD    (sizeof(sConfig_t) + 5)  // Seq, Version, Config, record CRC16
+#define WEARSLOTS     ((E2END + 1) / WEARRECORD)
+
+void setUp() {}
+void tearDown() {}
+
+static void test_wear() {
+  GetConfig();                          // journal position for the erased EEPROM
+  sConfig_t Config = InitDefaultConfig();
+  for (uint32_t i = 0; i < WEARCOMMITS; i++) {
+    Config.Timeout = 1 + (i & 0x7F);   // one setting changed per 'Save'
+    Config.CRC16   = CalcCRC(Config);
+    PutConfig(Config);
+  }
+
+  uint32_t Worst   = 0;
+  uint16_t WorstAt = 0;
+  uint16_t Never   = 0;
+  for (uint16_t a = 0; a <= E2END; a++) {
+    if (EEPROM.CellWrites[a] > Worst) {
+      Worst   = EEPROM.CellWrites[a];
+      WorstAt = a;
+    }
+    Never += (EEPROM.CellWrites[a] == 0);
+  }
+  printf("%lu commits, %u slots of %u bytes, %u bytes never written\n", WEARCOMMITS,
+         (unsigned) WEARSLOTS, (unsigned) WEARRECORD, Never);
+  for (uint16_t Slot = 0; Slot < WEARSLOTS; Slot++) {
+    uint32_t Most = 0;
+    uint32_t Sum  = 0;
+    for (uint16_t a = Slot * WEARRECORD; a < (Slot + 1) * WEARRECORD; a++) {
+      Most = (EEPROM.CellWrites[a] > Most) ? EEPROM.CellWrites[a] : Most;
+      Sum += EEPROM.CellWrites[a];
+    }
+    printf("  slot %2u, addr %3u, most %7lu writes, mean %9.1f\n", Slot, (unsigned) (Slot * WEARRECORD),
+           (unsigned long) Most, (double) Sum / WEARRECORD);
+  }
+  printf("worst byte %u, %lu writes, %lu commits to %lu writes, %lu for a single copy\n", WorstAt,
+         (unsigned long) Worst, WEARCOMMITS * WEARENDURANCE / Worst, WEARENDURANCE, WEARENDURANCE);
+
+  TEST_ASSERT_TRUE_MESSAGE(Worst <= (WEARCOMMITS + WEARSLOTS - 1) / WEARSLOTS,
+                           "a byte written more than once per slot in the ring");
+  sConfig_t Back = GetConfig();
+  TEST_ASSERT_TRUE_MESSAGE(isConfigValid(Back) && (Back.Timeout == Config.Timeout),
+                           "last commit does not read back");
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_wear);
+  return UNITY_END();
+}